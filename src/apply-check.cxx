@@ -0,0 +1,173 @@
+#include "apply-check.hxx"
+
+#include "git-fixes.hxx"
+#include "trace.hxx"
+#include "utility.hxx"
+
+#include <git2/cherrypick.h>
+#include <git2/commit.h>
+#include <git2/index.h>
+#include <git2/merge.h>
+#include <git2/odb.h>
+#include <git2/repository.h>
+#include <git2/sys/mempack.h>
+#include <git2/tree.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <ranges>
+#include <thread>
+
+namespace {
+	using RepositoryPtr = std::unique_ptr<git_repository, git_repo_deleter>;
+	using CommitPtr = std::unique_ptr<git_commit, git_commit_deleter>;
+
+	/**
+	 * @brief Repository handle whose object writes go to memory
+	 *
+	 * Merging the trees writes the merged blobs, with the in-memory backend added at the top priority those never
+	 * reach the disk.
+	 */
+	RepositoryPtr openInMemory(const char* path)
+	{
+		git_repository* repo;
+		LibgitError::check(git_repository_open(&repo, path));
+		RepositoryPtr result{repo};
+
+		git_odb* odb;
+		LibgitError::check(git_repository_odb(&odb, repo));
+		git_odb_backend* mempack;
+		int error = git_mempack_new(&mempack);
+		if (!error) {
+			error = git_odb_add_backend(odb, mempack, 999);
+		}
+		git_odb_free(odb);
+		LibgitError::check(error);
+		return result;
+	}
+
+	CommitPtr lookup(git_repository& repo, const git_oid& id)
+	{
+		git_commit* commit;
+		LibgitError::check(git_commit_lookup(&commit, &repo, &id));
+		return CommitPtr{commit};
+	}
+
+	/**
+	 * @brief Cherry-picks the commit onto ours, stores the tree of the result into tree if it applies cleanly
+	 *
+	 * @return ApplyStatus::Clean, ApplyStatus::Conflict or ApplyStatus::Error
+	 */
+	ApplyStatus cherryPick(git_repository& repo, git_commit& commit, git_commit& ours, git_oid& tree)
+	{
+		TraceSpan span{"cherry-pick"};
+		git_merge_options mergeOptions = GIT_MERGE_OPTIONS_INIT;
+		const unsigned mainline = git_commit_parentcount(&commit) > 1 ? 1 : 0;
+		git_index* index;
+		if (git_cherrypick_commit(&index, &repo, &commit, &ours, mainline, &mergeOptions)) {
+			return ApplyStatus::Error;
+		}
+		ApplyStatus result{ApplyStatus::Conflict};
+		if (!git_index_has_conflicts(index)) {
+			result = git_index_write_tree_to(&tree, index, &repo) ? ApplyStatus::Error : ApplyStatus::Clean;
+		}
+		git_index_free(index);
+		return result;
+	}
+
+	std::string_view statusName(ApplyStatus status)
+	{
+		switch (status) {
+			case ApplyStatus::Clean: return "clean";
+			case ApplyStatus::Dependent: return "depends";
+			case ApplyStatus::Conflict: return "conflict";
+			case ApplyStatus::Error: return "error";
+		}
+		return {};
+	}
+} // namespace
+
+std::vector<ApplyStatus> check_apply(
+	git_repository& repo, const git_oid& target, const std::vector<CommitWithReferences>& fixes, unsigned jobs)
+{
+	const char* path = git_repository_path(&repo);
+	std::vector<ApplyStatus> result(fixes.size(), ApplyStatus::Conflict);
+	if (jobs == 0) {
+		jobs = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	// every fix on top of the target alone
+	std::atomic<std::size_t> nextFix{0};
+	std::vector<std::string> errors(jobs);
+	auto worker = [&](std::string& error) {
+		try {
+			RepositoryPtr workerRepo{openInMemory(path)};
+			CommitPtr targetCommit{lookup(*workerRepo, target)};
+			for (std::size_t i = nextFix++; i < fixes.size(); i = nextFix++) {
+				CommitPtr fix{lookup(*workerRepo, fixes[i].id())};
+				git_oid tree;
+				result[i] = cherryPick(*workerRepo, *fix, *targetCommit, tree);
+			}
+		} catch (std::exception& ex) {
+			error = ex.what();
+		}
+	};
+	{
+		std::vector<std::jthread> threads;
+		for (unsigned i = 0; i < std::min<std::size_t>(jobs, fixes.size()); ++i) {
+			threads.emplace_back(worker, std::ref(errors[i]));
+		}
+	}
+	if (auto error = std::ranges::find_if(errors, [](const std::string& e) { return !e.empty(); }); error != errors.end()) {
+		throw std::runtime_error(*error);
+	}
+
+	// the conflicting ones on top of the preceding fixes that applied, in the order the script picks them
+	const std::vector<std::size_t> order{dependencyOrder(fixes)};
+	auto lastConflict = std::ranges::find(std::ranges::reverse_view{order}, ApplyStatus::Conflict, [&result](std::size_t i) {
+		return result[i];
+	});
+	const std::size_t chainLength = std::ranges::distance(lastConflict, order.rend());
+	RepositoryPtr chainRepo{openInMemory(path)};
+	CommitPtr chain{lookup(*chainRepo, target)};
+	for (std::size_t i: order | std::views::take(chainLength)) {
+		if (result[i] == ApplyStatus::Error) {
+			continue;
+		}
+		CommitPtr fix{lookup(*chainRepo, fixes[i].id())};
+		git_oid treeId;
+		const ApplyStatus status = cherryPick(*chainRepo, *fix, *chain, treeId);
+		if (status != ApplyStatus::Clean) {
+			if (status == ApplyStatus::Error && result[i] == ApplyStatus::Conflict) {
+				// whether it depends on the preceding fixes is unknown
+				result[i] = ApplyStatus::Error;
+			}
+			continue;
+		}
+		if (result[i] == ApplyStatus::Conflict) {
+			result[i] = ApplyStatus::Dependent;
+		}
+
+		git_tree* tree;
+		LibgitError::check(git_tree_lookup(&tree, chainRepo.get(), &treeId));
+		const git_commit* parents[] = {chain.get()};
+		git_oid commitId;
+		int error = git_commit_create(
+			&commitId, chainRepo.get(), nullptr, git_commit_author(fix.get()), git_commit_committer(fix.get()), nullptr,
+			git_commit_message(fix.get()), tree, 1, parents);
+		git_tree_free(tree);
+		LibgitError::check(error);
+		chain = lookup(*chainRepo, commitId);
+	}
+
+	return result;
+}
+
+void print_apply_check(std::ostream& out, git_repository& repo, const Options& opts, const std::vector<CommitWithReferences>& fixes)
+{
+	std::vector<ApplyStatus> statuses{check_apply(repo, resolve_commit(repo, opts.revision), fixes, opts.jobs)};
+	for (std::size_t i: dependencyOrder(fixes)) {
+		out << statusName(statuses[i]) << '\t' << oid_to_string(fixes[i].id()) << '\t' << fixes[i].summary() << '\n';
+	}
+}
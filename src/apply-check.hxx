@@ -0,0 +1,36 @@
+#pragma once
+
+#include "commit.hxx"
+
+#include <git2/types.h>
+
+#include <ostream>
+#include <vector>
+
+struct Options;
+
+enum class ApplyStatus {
+	// applies onto the target as is
+	Clean,
+	// applies only after some of the preceding fixes
+	Dependent,
+	Conflict,
+	// libgit2 failed to cherry-pick it
+	Error,
+};
+
+/**
+ * @brief Cherry-picks the fixes onto the target commit in memory and reports which of them apply
+ *
+ * Each fix is first tried on the target alone, these checks run concurrently on separate repository handles. The
+ * fixes that conflict are then tried again on top of the preceding fixes that applied, in dependencyOrder() like
+ * the cherry-pick script. Nothing is written to the worktree, the index or the object database. The statuses are
+ * in the order of the fixes.
+ */
+std::vector<ApplyStatus> check_apply(
+	git_repository& repo, const git_oid& target, const std::vector<CommitWithReferences>& fixes, unsigned jobs);
+
+/**
+ * @brief Prints the status of each fix, in the order the cherry-pick script picks them
+ */
+void print_apply_check(std::ostream& out, git_repository& repo, const Options& opts, const std::vector<CommitWithReferences>& fixes);
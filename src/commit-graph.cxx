@@ -0,0 +1,221 @@
+#include "commit-graph.hxx"
+
+#include "utility.hxx"
+
+#include <git2/repository.h>
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+	constexpr std::size_t oidSize{20};
+	// tree, two parent positions, generation with the commit time
+	constexpr std::size_t dataSize{oidSize + 16};
+	constexpr std::uint32_t noParent{0x70000000};
+	constexpr std::uint32_t extraEdges{0x80000000};
+
+	std::uint32_t readBig32(std::span<const std::byte> data, std::size_t offset)
+	{
+		std::uint32_t result{0};
+		for (std::size_t i = 0; i < 4; ++i) {
+			result = (result << 8) | std::to_integer<std::uint32_t>(data[offset + i]);
+		}
+		return result;
+	}
+
+	std::uint64_t readBig64(std::span<const std::byte> data, std::size_t offset)
+	{
+		return (std::uint64_t{readBig32(data, offset)} << 32) | readBig32(data, offset + 4);
+	}
+
+	constexpr std::uint32_t chunkId(const char (&name)[5])
+	{
+		return (std::uint32_t(name[0]) << 24) | (std::uint32_t(name[1]) << 16) | (std::uint32_t(name[2]) << 8) |
+		       std::uint32_t(name[3]);
+	}
+} // namespace
+
+CommitGraph::CommitGraph(std::vector<Layer> layers)
+	: layers_{std::move(layers)}
+{
+	for (const Layer& layer: layers_) {
+		size_ += layer.size;
+	}
+}
+
+std::optional<CommitGraph> CommitGraph::open(git_repository& repo)
+{
+	// git does not use the graph of a shallow clone either, the parents in it would be wrong
+	if (git_repository_is_shallow(&repo) > 0) {
+		return std::nullopt;
+	}
+
+	std::filesystem::path directory{std::filesystem::path{git_repository_commondir(&repo)} / "objects" / "info"};
+	std::vector<Layer> layers;
+	if (std::optional<Layer> single = openLayer(directory / "commit-graph", 0)) {
+		layers.push_back(std::move(*single));
+	} else {
+		// a split graph lists its layers from the base up, the valid prefix of the chain is still closed under
+		// reachability
+		std::ifstream chain{directory / "commit-graphs" / "commit-graph-chain"};
+		Position first{0};
+		for (std::string hash; std::getline(chain, hash);) {
+			std::optional<Layer> layer = openLayer(directory / "commit-graphs" / std::format("graph-{}.graph", hash), first);
+			if (!layer) {
+				break;
+			}
+			first += static_cast<Position>(layer->size);
+			layers.push_back(std::move(*layer));
+		}
+	}
+	if (layers.empty()) {
+		return std::nullopt;
+	}
+	return CommitGraph{std::move(layers)};
+}
+
+/**
+ * @brief Maps one graph file and locates its chunks, nullopt if it is missing or not in a format this reads
+ */
+std::optional<CommitGraph::Layer> CommitGraph::openLayer(const std::filesystem::path& path, Position first)
+{
+	std::error_code error;
+	if (!std::filesystem::is_regular_file(path, error)) {
+		return std::nullopt;
+	}
+	Layer layer{.file = MappedFile{path}, .fanout = {}, .oids = {}, .data = {}, .edges = {}, .first = first, .size = 0};
+	std::span<const std::byte> file{layer.file.data()};
+
+	// "CGPH", version 1, SHA-1, the number of chunks, the number of base graphs
+	constexpr std::size_t headerSize{8};
+	constexpr std::size_t chunkEntrySize{12};
+	if (file.size() < headerSize || std::memcmp(file.data(), "CGPH", 4) != 0 || file[4] != std::byte{1} ||
+	    file[5] != std::byte{1}) {
+		return std::nullopt;
+	}
+	const std::size_t chunks{std::to_integer<std::size_t>(file[6])};
+	if (file.size() < headerSize + (chunks + 1) * chunkEntrySize) {
+		return std::nullopt;
+	}
+	for (std::size_t i = 0; i < chunks; ++i) {
+		const std::size_t entry{headerSize + i * chunkEntrySize};
+		const std::uint64_t begin{readBig64(file, entry + 4)};
+		const std::uint64_t end{readBig64(file, entry + chunkEntrySize + 4)};
+		if (begin > end || end > file.size()) {
+			return std::nullopt;
+		}
+		std::span<const std::byte> chunk{file.subspan(begin, end - begin)};
+		switch (readBig32(file, entry)) {
+		case chunkId("OIDF"):
+			layer.fanout = chunk;
+			break;
+		case chunkId("OIDL"):
+			layer.oids = chunk;
+			break;
+		case chunkId("CDAT"):
+			layer.data = chunk;
+			break;
+		case chunkId("EDGE"):
+			layer.edges = chunk;
+			break;
+		default:
+			break;
+		}
+	}
+	if (layer.fanout.size() != 256 * 4) {
+		return std::nullopt;
+	}
+	layer.size = readBig32(layer.fanout, 255 * 4);
+	if (layer.size == 0 || layer.oids.size() != layer.size * oidSize || layer.data.size() != layer.size * dataSize) {
+		return std::nullopt;
+	}
+	// the graphs of the git versions before 2.19 have no generation numbers
+	if (readBig32(layer.data, oidSize + 8) >> 2 == 0) {
+		return std::nullopt;
+	}
+	return layer;
+}
+
+std::optional<CommitGraph::Position> CommitGraph::find(const git_oid& id) const
+{
+	const std::size_t bucket{id.id[0]};
+	for (const Layer& layer: layers_) {
+		std::size_t low{bucket ? readBig32(layer.fanout, (bucket - 1) * 4) : 0};
+		std::size_t high{readBig32(layer.fanout, bucket * 4)};
+		while (low < high) {
+			const std::size_t middle{low + (high - low) / 2};
+			const int order{std::memcmp(layer.oids.data() + middle * oidSize, id.id, oidSize)};
+			if (order == 0) {
+				return layer.first + static_cast<Position>(middle);
+			}
+			if (order < 0) {
+				low = middle + 1;
+			} else {
+				high = middle;
+			}
+		}
+	}
+	return std::nullopt;
+}
+
+const git_oid& CommitGraph::id(Position position) const
+{
+	const Layer& owner = layer(position);
+	return *reinterpret_cast<const git_oid*>(owner.oids.data() + (position - owner.first) * oidSize);
+}
+
+std::uint32_t CommitGraph::generation(Position position) const
+{
+	// the topological level takes the upper 30 bits, the rest is the commit time
+	return readBig32(entry(position), oidSize + 8) >> 2;
+}
+
+void CommitGraph::parents(Position position, std::vector<Position>& result) const
+{
+	std::span<const std::byte> data{entry(position)};
+	const std::uint32_t first{readBig32(data, oidSize)};
+	if (first == noParent) {
+		return;
+	}
+	result.push_back(first);
+	const std::uint32_t second{readBig32(data, oidSize + 4)};
+	if (second == noParent) {
+		return;
+	}
+	if (!(second & extraEdges)) {
+		result.push_back(second);
+		return;
+	}
+	// the parents of an octopus merge from the second on are listed in the extra edges, the last one is marked
+	std::span<const std::byte> edges{layer(position).edges};
+	for (std::size_t index = second & ~extraEdges;; ++index) {
+		if ((index + 1) * 4 > edges.size()) {
+			throw std::runtime_error(std::format("The commit-graph entry of {} is corrupt", oid_to_string(id(position))));
+		}
+		const std::uint32_t edge{readBig32(edges, index * 4)};
+		result.push_back(edge & ~extraEdges);
+		if (edge & extraEdges) {
+			return;
+		}
+	}
+}
+
+const CommitGraph::Layer& CommitGraph::layer(Position position) const
+{
+	for (const Layer& candidate: layers_) {
+		if (position - candidate.first < candidate.size) {
+			return candidate;
+		}
+	}
+	throw std::out_of_range(std::format("No commit at the commit-graph position {}", position));
+}
+
+std::span<const std::byte> CommitGraph::entry(Position position) const
+{
+	const Layer& owner = layer(position);
+	return owner.data.subspan((position - owner.first) * dataSize, dataSize);
+}
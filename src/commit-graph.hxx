@@ -0,0 +1,64 @@
+#pragma once
+
+#include "mapped-file.hxx"
+
+#include <git2/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <vector>
+
+/**
+ * @brief Read-only view of the commit-graph file, or chain of files, git writes into the object directory
+ *
+ * Gives the parents and the topological levels (generation numbers) of the commits in it without reading the
+ * commit objects. The graph is closed under reachability: the parents of a commit in it are in it as well, and a
+ * commit's generation is above those of its parents.
+ */
+class CommitGraph {
+public:
+	using Position = std::uint32_t;
+
+	// generation of the commits missing in the graph, not below the generation of any commit in it
+	static constexpr std::uint32_t infiniteGeneration{std::numeric_limits<std::uint32_t>::max()};
+
+	/**
+	 * @brief Opens the commit-graph of the repository, nullopt if there is none or git would not use it
+	 */
+	static std::optional<CommitGraph> open(git_repository& repo);
+
+	std::size_t size() const { return size_; }
+
+	std::optional<Position> find(const git_oid& id) const;
+	const git_oid& id(Position position) const;
+	std::uint32_t generation(Position position) const;
+
+	/**
+	 * @brief Appends the positions of the parents of the commit to the result
+	 */
+	void parents(Position position, std::vector<Position>& result) const;
+
+private:
+	struct Layer {
+		MappedFile file;
+		std::span<const std::byte> fanout;
+		std::span<const std::byte> oids;
+		std::span<const std::byte> data;
+		std::span<const std::byte> edges;
+		// position of the first commit of the layer in the whole chain
+		Position first;
+		std::size_t size;
+	};
+
+	explicit CommitGraph(std::vector<Layer> layers);
+
+	static std::optional<Layer> openLayer(const std::filesystem::path& path, Position first);
+	const Layer& layer(Position position) const;
+	std::span<const std::byte> entry(Position position) const;
+
+	std::vector<Layer> layers_;
+	std::size_t size_{0};
+};
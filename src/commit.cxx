@@ -1,12 +1,19 @@
 #include "commit.hxx"
 
 #include "note.hxx"
+#include "trace.hxx"
 #include "utility.hxx"
 
 #include <git2/commit.h>
+#include <git2/odb.h>
+#include <git2/repository.h>
 
 #include <cassert>
 #include <format>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <unordered_map>
 #include <utility>
 
 #include "git-list-fixes-config.hxx"
@@ -18,6 +25,35 @@
 namespace {
 	constexpr std::string_view clearMessageCommand{"{clear}\n"};
 
+	/**
+	 * @brief The message amended by the note of the commit, std::nullopt if there is no note
+	 */
+	std::optional<std::string> applyNote(git_repository& repo, const git_oid& id, std::string_view message)
+	{
+		TraceSpan span{"note lookup"};
+		Note note{id, repo};
+		std::string_view noteText{trimWhitespace(note.text())};
+		if (noteText.empty()) {
+			return std::nullopt;
+		}
+		std::string_view::size_type lastClear = noteText.rfind(clearMessageCommand);
+		if (lastClear == std::string_view::npos) {
+			return std::string{message} + std::string{noteText};
+		}
+		return std::string{noteText.substr(lastClear + clearMessageCommand.size())};
+	}
+
+	/**
+	 * @brief Splits off the first line of the text, without the line break
+	 */
+	std::string_view takeLine(std::string_view& text)
+	{
+		std::string_view::size_type end = text.find('\n');
+		std::string_view line{text.substr(0, end)};
+		text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+		return line;
+	}
+
 #ifndef Git_FOUND
 	std::string indentLines(const char* text, unsigned width)
 	{
@@ -36,21 +72,12 @@ namespace {
 
 Commit::Commit(git_repository& repo, const git_oid& id)
 {
+	TraceSpan span{"lookup commit"};
 	LibgitError::check(git_commit_lookup(&commit_, &repo, &id));
 	assert(commit_);
 
-	Note note{*this, repo};
-	std::string_view noteText{trimWhitespace(note.text())};
-	if (noteText.empty()) {
-		message_ = std::string{git_commit_message(commit_)};
-	} else {
-		std::string_view::size_type lastClear = noteText.rfind(clearMessageCommand);
-		if (lastClear == std::string_view::npos) {
-			message_ = std::string{git_commit_message(commit_)} + std::string{noteText};
-		} else {
-			message_ = std::string{noteText.substr(lastClear + clearMessageCommand.size())};
-		}
-	}
+	std::string_view message{git_commit_message(commit_)};
+	message_ = applyNote(repo, id, message).value_or(std::string{message});
 }
 
 Commit::Commit(Commit&& other) noexcept
@@ -69,6 +96,7 @@ Commit::~Commit()
 Commit& Commit::operator=(Commit&& other) noexcept
 {
 	std::swap(commit_, other.commit_);
+	std::swap(message_, other.message_);
 	return *this;
 }
 
@@ -80,11 +108,12 @@ const git_oid& Commit::id() const
 std::string Commit::logFormat(std::string_view format) const
 {
 #ifdef Git_FOUND
-	std::string command = "git log --color=always -1 ";
+	TraceSpan span{"git log"};
+	// the repository is not necessarily the one in the current directory
+	std::string command = std::format(
+		"git --git-dir={} log --color=always -1 ", shellQuote(git_repository_path(git_commit_owner(commit_))));
 	if (!format.empty()) {
-		command.reserve(command.size() + 11 + format.size());
-		command += " --format=";
-		command += format;
+		command += shellQuote(std::format("--format={}", format));
 		command += ' ';
 	}
 	std::size_t id_pos = command.size();
@@ -125,6 +154,12 @@ std::string Commit::logFormat(std::string_view format) const
 #endif
 }
 
+std::string_view Commit::summary() const
+{
+	std::string_view message{git_commit_message(commit_)};
+	return trimWhitespace(message.substr(0, message.find('\n')));
+}
+
 std::string_view Commit::authorEmail() const
 {
 	return {git_commit_author(commit_)->email};
@@ -147,3 +182,120 @@ CommitWithReferences::CommitWithReferences(Commit&& commit, std::vector<Referenc
 	, references_{std::move(references)}
 {
 }
+
+std::vector<std::size_t> dependencyOrder(const std::vector<CommitWithReferences>& fixes)
+{
+	std::unordered_map<git_oid, std::size_t, OidHash> indices;
+	for (std::size_t i = 0; i < fixes.size(); ++i) {
+		indices.emplace(fixes[i].id(), i);
+	}
+	std::vector<std::vector<std::size_t>> dependents(fixes.size());
+	std::vector<std::size_t> dependencies(fixes.size(), 0);
+	for (std::size_t i = 0; i < fixes.size(); ++i) {
+		for (const Reference& ref: fixes[i].references()) {
+			if (auto dependency = indices.find(ref.id); dependency != indices.end() && dependency->second != i) {
+				dependents[dependency->second].push_back(i);
+				++dependencies[i];
+			}
+		}
+	}
+
+	std::priority_queue<std::size_t, std::vector<std::size_t>, std::greater<>> ready;
+	for (std::size_t i = 0; i < fixes.size(); ++i) {
+		if (dependencies[i] == 0) {
+			ready.push(i);
+		}
+	}
+	std::vector<std::size_t> result;
+	result.reserve(fixes.size());
+	while (!ready.empty()) {
+		const std::size_t index = ready.top();
+		ready.pop();
+		result.push_back(index);
+		for (std::size_t dependent: dependents[index]) {
+			if (--dependencies[dependent] == 0) {
+				ready.push(dependent);
+			}
+		}
+	}
+	// the history has no cycles, but the references might
+	for (std::size_t i = 0; i < fixes.size(); ++i) {
+		if (dependencies[i] > 0) {
+			result.push_back(i);
+		}
+	}
+	return result;
+}
+
+RawCommit::RawCommit(git_repository& repo, const git_oid& id, Notes notes)
+	: id_{id}
+{
+	TraceSpan span{"read commit"};
+	git_odb* odb;
+	LibgitError::check(git_repository_odb(&odb, &repo));
+	int error = git_odb_read(&object_, odb, &id);
+	git_odb_free(odb);
+	LibgitError::check(error);
+	if (git_odb_object_type(object_) != GIT_OBJECT_COMMIT) {
+		git_odb_object_free(object_);
+		throw std::runtime_error(std::format("{} is not a commit", oid_to_string(id)));
+	}
+
+	std::string_view text{static_cast<const char*>(git_odb_object_data(object_)), git_odb_object_size(object_)};
+	constexpr std::string_view parentHeader{"parent "};
+	constexpr std::string_view authorHeader{"author "};
+	// the headers end with an empty line, the continuation lines of the multi-line ones start with a space
+	for (std::string_view line = takeLine(text); !line.empty(); line = takeLine(text)) {
+		if (line.starts_with(parentHeader)) {
+			git_oid parent;
+			if (!git_oid_fromstrn(&parent, line.data() + parentHeader.size(), line.size() - parentHeader.size())) {
+				parents_.push_back(parent);
+			}
+		} else if (line.starts_with(authorHeader)) {
+			std::string_view::size_type emailStart = line.find('<');
+			std::string_view::size_type emailEnd = line.find('>', emailStart);
+			if (emailStart != std::string_view::npos && emailEnd != std::string_view::npos) {
+				authorEmail_ = line.substr(emailStart + 1, emailEnd - emailStart - 1);
+			}
+		}
+	}
+	rawMessage_ = text;
+	if (notes == Notes::Apply) {
+		amendedMessage_ = applyNote(repo, id, rawMessage_);
+	}
+}
+
+std::string_view RawCommit::summary() const
+{
+	std::string_view text{rawMessage_};
+	text.remove_prefix(std::min(text.find_first_not_of('\n'), text.size()));
+	return text.substr(0, text.find("\n\n"));
+}
+
+RawCommit::RawCommit(RawCommit&& other) noexcept
+	: object_{std::exchange(other.object_, nullptr)}
+	, id_{other.id_}
+	, parents_{std::move(other.parents_)}
+	, authorEmail_{other.authorEmail_}
+	, rawMessage_{other.rawMessage_}
+	, amendedMessage_{std::move(other.amendedMessage_)}
+{
+}
+
+RawCommit::~RawCommit()
+{
+	if (object_) {
+		git_odb_object_free(object_);
+	}
+}
+
+RawCommit& RawCommit::operator=(RawCommit&& other) noexcept
+{
+	std::swap(object_, other.object_);
+	std::swap(id_, other.id_);
+	std::swap(parents_, other.parents_);
+	std::swap(authorEmail_, other.authorEmail_);
+	std::swap(rawMessage_, other.rawMessage_);
+	std::swap(amendedMessage_, other.amendedMessage_);
+	return *this;
+}
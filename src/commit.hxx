@@ -4,7 +4,12 @@
 
 #include <git2/types.h>
 
+#include <git2/oid.h>
+
+#include <cstddef>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class Commit {
@@ -27,6 +32,11 @@ public:
 
 	const std::string& message() const { return message_; }
 
+	/**
+	 * @brief The first line of the commit message
+	 */
+	std::string_view summary() const;
+
 	std::string logFormat(std::string_view format = {}) const;
 
 	std::string_view authorEmail() const;
@@ -47,3 +57,54 @@ public:
 private:
 	std::vector<Reference> references_;
 };
+
+/**
+ * @brief Order of the fixes in which every fix comes after the listed commits it references
+ *
+ * Otherwise the original order is kept as far as possible. The cherry-pick script and the apply check both
+ * replay the fixes in this order.
+ */
+std::vector<std::size_t> dependencyOrder(const std::vector<CommitWithReferences>& fixes);
+
+/**
+ * @brief Commit data the scan needs, parsed from the raw object
+ *
+ * Unlike Commit it bypasses the parsed commit cache of libgit2: the raw object is read from the object database,
+ * only the parent and author headers are parsed and the message is viewed in place. Notes are applied the same way.
+ */
+class RawCommit {
+public:
+	// whether the notes are looked up, the history walks only need the parents
+	enum class Notes { Apply, Skip };
+
+	RawCommit(git_repository& repo, const git_oid& id, Notes notes = Notes::Apply);
+	RawCommit(RawCommit&& other) noexcept;
+	~RawCommit();
+
+	RawCommit& operator=(RawCommit&& other) noexcept;
+
+	RawCommit(const RawCommit&) = delete;
+	RawCommit& operator=(const RawCommit&) = delete;
+
+	const git_oid& id() const { return id_; }
+	const std::vector<git_oid>& parents() const { return parents_; }
+
+	std::string_view message() const { return amendedMessage_ ? std::string_view{*amendedMessage_} : rawMessage_; }
+
+	/**
+	 * @brief The first paragraph of the message without the notes, like git_commit_summary before the line
+	 * breaks are folded
+	 */
+	std::string_view summary() const;
+	std::string_view authorEmail() const { return authorEmail_; }
+
+private:
+	git_odb_object* object_;
+	git_oid id_;
+	std::vector<git_oid> parents_;
+	// views into the object data
+	std::string_view authorEmail_;
+	std::string_view rawMessage_;
+	// the message with the notes applied, when there are any
+	std::optional<std::string> amendedMessage_;
+};
@@ -48,6 +48,15 @@ std::optional<std::string> Config::readString(const char* key) const
 	return res;
 }
 
+std::optional<std::int64_t> Config::readInt64(const char* key) const
+{
+	std::int64_t value;
+	if (git_config_get_int64(&value, config_, key)) {
+		return std::nullopt;
+	}
+	return value;
+}
+
 namespace {
 	int readMultiStringCallback(const git_config_entry* entry, void* payload)
 	{
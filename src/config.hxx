@@ -2,6 +2,7 @@
 
 #include <git2/types.h>
 
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <vector>
@@ -17,6 +18,10 @@ public:
 	Config& operator=(const Config&) = delete;
 
 	std::optional<std::string> readString(const char* key) const;
+	/**
+	 * @brief Reads an integer, the k, m and g suffixes are recognised
+	 */
+	std::optional<std::int64_t> readInt64(const char* key) const;
 	std::vector<std::string> readMultiString(const char* key) const;
 
 private:
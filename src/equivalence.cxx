@@ -0,0 +1,127 @@
+#include "equivalence.hxx"
+
+#include "utility.hxx"
+
+#include <git2/commit.h>
+#include <git2/diff.h>
+#include <git2/message.h>
+#include <git2/tree.h>
+
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <span>
+#include <utility>
+
+void CommitEquivalence::join(const git_oid& left, const git_oid& right)
+{
+	std::size_t leftRoot = root(insert(left));
+	std::size_t rightRoot = root(insert(right));
+	if (leftRoot == rightRoot) {
+		return;
+	}
+	if (sizes_[leftRoot] < sizes_[rightRoot]) {
+		std::swap(leftRoot, rightRoot);
+	}
+	parents_[rightRoot] = leftRoot;
+	sizes_[leftRoot] += sizes_[rightRoot];
+	marks_[leftRoot] |= marks_[rightRoot];
+}
+
+void CommitEquivalence::mark(const git_oid& id, Marks marks)
+{
+	marks_[root(insert(id))] |= marks;
+}
+
+CommitEquivalence::Marks CommitEquivalence::marks(const git_oid& id)
+{
+	std::optional<std::size_t> node{find(id)};
+	return node ? marks_[root(*node)] : Marks{0};
+}
+
+std::size_t CommitEquivalence::insert(const git_oid& id)
+{
+	auto [node, inserted] = nodes_.try_emplace(id, parents_.size());
+	if (inserted) {
+		parents_.push_back(node->second);
+		sizes_.push_back(1);
+		marks_.push_back(0);
+	}
+	return node->second;
+}
+
+std::optional<std::size_t> CommitEquivalence::find(const git_oid& id)
+{
+	auto node = nodes_.find(id);
+	return node == nodes_.end() ? std::nullopt : std::optional{node->second};
+}
+
+std::size_t CommitEquivalence::root(std::size_t node)
+{
+	// path halving
+	while (parents_[node] != node) {
+		parents_[node] = parents_[parents_[node]];
+		node = parents_[node];
+	}
+	return node;
+}
+
+namespace {
+	struct git_tree_deleter {
+		void operator()(git_tree* tree) { git_tree_free(tree); }
+	};
+
+	struct git_diff_deleter {
+		void operator()(git_diff* diff) { git_diff_free(diff); }
+	};
+} // namespace
+
+std::optional<git_oid> patch_id(git_repository& repo, const git_oid& commit)
+{
+	git_commit* commitPtr;
+	LibgitError::check(git_commit_lookup(&commitPtr, &repo, &commit));
+	std::unique_ptr<git_commit, git_commit_deleter> child{commitPtr};
+	if (git_commit_parentcount(child.get()) != 1) {
+		return std::nullopt;
+	}
+	LibgitError::check(git_commit_parent(&commitPtr, child.get(), 0));
+	std::unique_ptr<git_commit, git_commit_deleter> parent{commitPtr};
+
+	git_tree* treePtr;
+	LibgitError::check(git_commit_tree(&treePtr, child.get()));
+	std::unique_ptr<git_tree, git_tree_deleter> newTree{treePtr};
+	LibgitError::check(git_commit_tree(&treePtr, parent.get()));
+	std::unique_ptr<git_tree, git_tree_deleter> oldTree{treePtr};
+
+	git_diff* diffPtr;
+	LibgitError::check(git_diff_tree_to_tree(&diffPtr, &repo, oldTree.get(), newTree.get(), nullptr));
+	std::unique_ptr<git_diff, git_diff_deleter> diff{diffPtr};
+	if (git_diff_num_deltas(diff.get()) == 0) {
+		// all the empty commits would be equivalent otherwise
+		return std::nullopt;
+	}
+	git_oid result;
+	LibgitError::check(git_diff_patchid(&result, diff.get(), nullptr));
+	return result;
+}
+
+std::optional<std::string> identity_trailer(std::string_view message, std::string_view key)
+{
+	git_message_trailer_array trailers;
+	LibgitError::check(git_message_trailers(&trailers, std::string{message}.c_str()));
+	auto sameKey = [key](const git_message_trailer& trailer) {
+		return std::ranges::equal(std::string_view{trailer.key}, key, [](char left, char right) {
+			return std::tolower(static_cast<unsigned char>(left)) == std::tolower(static_cast<unsigned char>(right));
+		});
+	};
+	std::span<git_message_trailer> all{trailers.trailers, trailers.count};
+	std::optional<std::string> result;
+	if (auto trailer = std::ranges::find_if(all, sameKey); trailer != all.end()) {
+		result = trimWhitespace(std::string_view{trailer->value});
+	}
+	git_message_trailer_array_free(&trailers);
+	if (result && result->empty()) {
+		return std::nullopt;
+	}
+	return result;
+}
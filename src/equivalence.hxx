@@ -0,0 +1,51 @@
+#pragma once
+
+#include "utility.hxx"
+
+#include <git2/types.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Classes of commits that carry the same change, e.g. a commit and its cherry-picked copies
+ *
+ * A union-find over commit ids. Each class has a set of marks, joining two classes unites their marks. A commit
+ * that was never joined forms a class of its own without marks.
+ */
+class CommitEquivalence {
+public:
+	using Marks = std::uint8_t;
+
+	void join(const git_oid& left, const git_oid& right);
+	void mark(const git_oid& id, Marks marks);
+
+	Marks marks(const git_oid& id);
+
+private:
+	std::size_t insert(const git_oid& id);
+	std::optional<std::size_t> find(const git_oid& id);
+	std::size_t root(std::size_t node);
+
+	std::unordered_map<git_oid, std::size_t, OidHash> nodes_;
+	std::vector<std::size_t> parents_;
+	// valid for the roots only
+	std::vector<std::size_t> sizes_;
+	std::vector<Marks> marks_;
+};
+
+/**
+ * @brief Patch id of the change a non-merge commit introduces, std::nullopt for merges and root commits
+ */
+std::optional<git_oid> patch_id(git_repository& repo, const git_oid& commit);
+
+/**
+ * @brief Value of the first trailer with the key in the commit message, the key is compared case-insensitively
+ *
+ * With a key like Change-Id, the trailer identifies the change across the branches it was picked to.
+ */
+std::optional<std::string> identity_trailer(std::string_view message, std::string_view key);
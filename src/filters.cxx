@@ -1,16 +1,21 @@
 #include "filters.hxx"
 
 #include "config.hxx"
+#include "subject-index.hxx"
+#include "trace.hxx"
 #include "utility.hxx"
 
 #include <git2/commit.h>
 #include <git2/config.h>
+#include <git2/object.h>
+#include <git2/oid.h>
 #include <git2/repository.h>
 #include <git2/revparse.h>
 
 #include <algorithm>
 #include <cassert>
 #include <format>
+#include <optional>
 #include <ranges>
 #include <regex>
 #include <stdexcept>
@@ -31,6 +36,41 @@ namespace {
 		}
 		return res;
 	}
+
+	void checkFixesMatchers(const std::vector<std::regex>& matchers, const std::vector<std::string>& expressions)
+	{
+		for (const std::tuple<const std::regex&, const std::string&> rs: std::views::zip(matchers, expressions)) {
+			if (std::get<0>(rs).mark_count() < 1) {
+				throw WrongMatcherRegex{
+					std::format("Expected at least one capture group in fixes matching expression '{}'", std::get<1>(rs))};
+			}
+		}
+	}
+
+	template <typename Function>
+	void forEachLine(std::string_view text, Function f)
+	{
+		while (!text.empty()) {
+			std::string_view::size_type end = text.find('\n');
+			f(text.substr(0, end));
+			text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+		}
+	}
+
+	// the full commit id following the marker in the line
+	std::optional<git_oid> idAfter(std::string_view line, std::string_view marker)
+	{
+		std::string_view::size_type start = line.find(marker);
+		if (start == std::string_view::npos || line.size() < start + marker.size() + 40) {
+			return std::nullopt;
+		}
+		std::string_view id = line.substr(start + marker.size(), 40);
+		git_oid oid;
+		if (!ishex(id) || git_oid_fromstrn(&oid, id.data(), id.size())) {
+			return std::nullopt;
+		}
+		return oid;
+	}
 } // namespace
 
 class AuthorFilter: public CommitFilter {
@@ -40,104 +80,55 @@ public:
 	{
 	}
 
-	bool operator()(const Commit& commit) const override { return email_ == commit.authorEmail(); }
+	bool operator()(const RawCommit& commit) const override { return email_ == commit.authorEmail(); }
 
 	std::string email_;
 };
 
-FixesFilter::FixesFilter(const std::vector<std::string>& matchExpressions, git_repository& repo)
-	: matchers_{makeMatchers(matchExpressions)}
+ReferenceTokenizer::ReferenceTokenizer(
+	const std::vector<std::string>& fixesExpressions, git_repository& repo, std::shared_ptr<SubjectIndex> subjects)
+	: fixesMatchers_{makeMatchers(fixesExpressions)}
 	, repo_{repo}
+	, subjects_{std::move(subjects)}
 {
-	for (const std::tuple<const std::regex&, const std::string&> rs: std::views::zip(matchers_, matchExpressions)) {
-		if (std::get<0>(rs).mark_count() < 1) {
-			throw WrongMatcherRegex{
-				std::format("Expected at least one capture group in fixes matching expression '{}'", std::get<1>(rs))};
-		}
-	}
+	checkFixesMatchers(fixesMatchers_, fixesExpressions);
 }
 
-bool FixesFilter::operator()(const Commit& commit) const
+std::vector<Reference> ReferenceTokenizer::operator()(const RawCommit& commit) const
 {
-	auto end{std::cregex_iterator()};
-	std::string_view message{commit.message()};
-	for (const std::regex& matcher: matchers_) {
-		for (auto iter = std::cregex_iterator(message.data(), message.data() + message.size(), matcher); iter != end;
-		     ++iter) {
-			return true;
+	TraceSpan span{"extract references"};
+	std::vector<Reference> result;
+	forEachLine(commit.message(), [&](std::string_view line) {
+		if (std::optional<git_oid> id = idAfter(line, revertMessage)) {
+			result.push_back({.id = *id, .kind = Reference::Kind::Revert});
+			return;
 		}
-	}
-	return false;
-	/*
-	        std::cout << "Found " << std::distance(words_begin, words_end) << " words:\n";
-
-	        for (std::sregex_iterator i = words_begin; i != words_end; ++i) {
-	            std::smatch match = *i;
-	            std::string match_str = match.str();
-	            std::cout << match_str << '\n';
-	        }
-	*/
-}
-
-std::vector<git_oid> FixesFilter::extract(const Commit& commit) const
-{
-	std::vector<git_oid> result;
-
-	std::string_view message{commit.message()};
-
-	for (const std::regex& matcher: matchers_) {
-		const char* msg = message.data();
-		for (std::cmatch match; std::regex_search(msg, match, matcher);) {
-			assert(match.length(1) > 0);
-			git_object* obj;
-			int error = git_revparse_single(&obj, &repo_, match[1].str().c_str());
-			if (!error) {
-				result.push_back(*git_object_id(obj));
-				git_object_free(obj);
-			}
-			msg = match.suffix().first;
+		if (std::optional<git_oid> id = idAfter(line, cherryPickedMessage)) {
+			result.push_back({.id = *id, .kind = Reference::Kind::CherryPick});
+			return;
 		}
-	}
-	return result;
-}
-
-bool StdGitMessageExtractor::operator()(const Commit& commit) const
-{
-	std::string_view message{commit.message()};
-	return message.find(messageStart_) != std::string_view::npos;
-}
-
-std::vector<git_oid> StdGitMessageExtractor::extract(const Commit& commit) const
-{
-	std::vector<git_oid> result;
-	std::string_view message{commit.message()};
-
-	auto lineStart = message.find(messageStart_);
-	if (lineStart != std::string_view::npos && message.size() >= lineStart + messageStart_.size() + 40) {
-		std::string_view id = message.substr(lineStart + messageStart_.size(), 40);
-		if (ishex(id)) {
-			git_oid oid{0};
-			LibgitError::check(git_oid_fromstr(&oid, id.data()));
-			result.push_back(oid);
+		for (const std::regex& matcher: fixesMatchers_) {
+			for (auto iter = std::cregex_iterator(line.data(), line.data() + line.size(), matcher);
+			     iter != std::cregex_iterator(); ++iter) {
+				assert((*iter).length(1) > 0);
+				git_object* obj;
+				if (!git_revparse_single(&obj, &repo_, (*iter)[1].str().c_str())) {
+					result.push_back({.id = *git_object_id(obj), .kind = Reference::Kind::Fixes});
+					git_object_free(obj);
+				} else if (subjects_ && (*iter).size() > 2 && (*iter)[2].matched) {
+					if (std::optional<git_oid> id = subjects_->find(repo_, (*iter)[2].str())) {
+						result.push_back({.id = *id, .kind = Reference::Kind::Fixes});
+					}
+				}
+			}
 		}
-	}
+	});
 	return result;
 }
 
-StdGitMessageExtractor::StdGitMessageExtractor(git_repository& repo, std::string_view messageStart)
-	: repo_{repo}
-	, messageStart_{messageStart}
-{
-}
-
-RevertFilter::RevertFilter(git_repository& repo)
-	: StdGitMessageExtractor{repo, revertMessage}
-{
-}
-
-CherryPickedFilter::CherryPickedFilter(git_repository& repo)
-	: StdGitMessageExtractor{repo, cherryPickedMessage}
+bool ReferenceTokenizer::capturesSubjects(const std::vector<std::string>& fixesExpressions)
 {
+	return std::ranges::any_of(makeMatchers(fixesExpressions), [](const std::regex& matcher) { return matcher.mark_count() > 1; });
 }
 
 TagMatcher::TagMatcher(
@@ -153,8 +144,9 @@ TagMatcher::TagMatcher(
 	}
 }
 
-bool TagMatcher::operator()(const Commit& commit) const
+bool TagMatcher::operator()(const RawCommit& commit) const
 {
+	TraceSpan span{"match tags"};
 	std::string_view message{commit.message()};
 
 	for (const std::regex& matcher: matchers_) {
@@ -174,19 +166,11 @@ bool TagMatcher::operator()(const Commit& commit) const
 	return false;
 }
 
-bool CompoundFilter::operator()(const Commit& commit) const
+bool CompoundFilter::operator()(const RawCommit& commit) const
 {
 	return std::ranges::all_of(filters_, [&commit](const auto& filter) { return (*filter)(commit); });
 }
 
-std::unique_ptr<ReferenceExtractingFilter> fixesFilter(const Options& opts, git_repository& repo)
-{
-	if (opts.fixes_matchers.empty()) {
-		throw std::runtime_error("Fixes matchers are not defined");
-	}
-	return std::make_unique<FixesFilter>(opts.fixes_matchers, repo);
-}
-
 CompoundFilter filterForSources(const Options& opts, git_repository& repo)
 {
 	std::string author = opts.author;
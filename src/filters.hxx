@@ -1,6 +1,7 @@
 #pragma once
 
 #include "git-fixes.hxx"
+#include "reference.hxx"
 
 #include <git2/types.h>
 
@@ -10,7 +11,8 @@
 #include <stdexcept>
 #include <string_view>
 
-class Commit;
+class RawCommit;
+class SubjectIndex;
 
 class WrongMatcherRegex: public std::runtime_error {
 	using std::runtime_error::runtime_error;
@@ -18,52 +20,34 @@ class WrongMatcherRegex: public std::runtime_error {
 
 struct CommitFilter {
 	virtual ~CommitFilter() = default;
-	virtual bool operator()(const Commit& commit) const = 0;
-};
-
-struct ReferenceExtractingFilter: CommitFilter {
-	virtual std::vector<git_oid> extract(const Commit& commit) const = 0;
-};
-
-class StdGitMessageExtractor: public ReferenceExtractingFilter {
-	using base = ReferenceExtractingFilter;
-
-public:
-	bool operator()(const Commit& commit) const override;
-	std::vector<git_oid> extract(const Commit& commit) const override;
-
-protected:
-	StdGitMessageExtractor(git_repository& repo, std::string_view messageStart);
-
-private:
-	git_repository& repo_;
-	std::string_view messageStart_;
-};
-
-class RevertFilter: public StdGitMessageExtractor {
-public:
-	RevertFilter(git_repository& repo);
-};
-
-class CherryPickedFilter: public StdGitMessageExtractor {
-public:
-	CherryPickedFilter(git_repository& repo);
+	virtual bool operator()(const RawCommit& commit) const = 0;
 };
 
 /**
- * @brief Extracts Fixes: like references
+ * @brief Extracts the references of all kinds in a single pass over the message lines
+ *
+ * Recognises the revert and cherry-pick lines git writes and the lines matching the fixes expressions, every
+ * occurrence of those is reported. A fixes reference whose id does not resolve is looked up by the subject in the
+ * second capture group of its expression, if there is one and the subject index is given.
  */
-class FixesFilter: public ReferenceExtractingFilter {
-	using base = ReferenceExtractingFilter;
-
+class ReferenceTokenizer {
 public:
-	FixesFilter(const std::vector<std::string>& matchExpressions, git_repository& repo);
-	bool operator()(const Commit& commit) const override;
-	std::vector<git_oid> extract(const Commit& commit) const override;
+	ReferenceTokenizer(
+		const std::vector<std::string>& fixesExpressions,
+		git_repository& repo,
+		std::shared_ptr<SubjectIndex> subjects = {});
+
+	std::vector<Reference> operator()(const RawCommit& commit) const;
+
+	/**
+	 * @brief Whether any of the fixes expressions captures a subject, only then a subject index is of use
+	 */
+	static bool capturesSubjects(const std::vector<std::string>& fixesExpressions);
 
 private:
-	std::vector<std::regex> matchers_;
+	std::vector<std::regex> fixesMatchers_;
 	git_repository& repo_;
+	std::shared_ptr<SubjectIndex> subjects_;
 };
 
 /**
@@ -73,7 +57,7 @@ class TagMatcher: CommitFilter {
 public:
 	TagMatcher(
 		const std::vector<std::string>& matchExpressions, std::map<std::string, std::vector<std::string>> targetTags);
-	bool operator()(const Commit& commit) const override;
+	bool operator()(const RawCommit& commit) const override;
 
 private:
 	std::vector<std::regex> matchers_;
@@ -84,7 +68,7 @@ class CompoundFilter: public CommitFilter {
 public:
 	void push_back(std::unique_ptr<CommitFilter> filter) { filters_.push_back(std::move(filter)); }
 
-	bool operator()(const Commit& commit) const override;
+	bool operator()(const RawCommit& commit) const override;
 
 private:
 	std::vector<std::unique_ptr<CommitFilter>> filters_;
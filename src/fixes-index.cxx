@@ -0,0 +1,324 @@
+#include "fixes-index.hxx"
+
+#include "filters.hxx"
+#include "git-fixes.hxx"
+#include "trace.hxx"
+#include "utility.hxx"
+
+#include <git2/graph.h>
+#include <git2/merge.h>
+#include <git2/object.h>
+#include <git2/oid.h>
+#include <git2/oidarray.h>
+#include <git2/repository.h>
+#include <git2/revparse.h>
+#include <git2/revwalk.h>
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+	constexpr char magic[8] = {'L', 'F', 'I', 'X', 'I', 'D', 'X', '2'};
+	// the delta is merged into the base once it has more than 1/deltaRatio of the base entries
+	constexpr std::size_t deltaRatio{8};
+
+	struct Header {
+		char magic[8];
+		std::uint32_t tipCount;
+		std::uint32_t reserved;
+		std::uint64_t entryCount;
+		// for a delta, the key of the base it extends
+		std::uint64_t baseKey;
+	};
+
+	std::filesystem::path indexPath(git_repository& repo, const Options& opts)
+	{
+		// the index is only valid for the matchers it was built with
+		std::uint64_t hash{fnv1aOffsetBasis};
+		for (const std::string& source: opts.sources) {
+			hash = fnv1a(hash, source);
+		}
+		for (const std::string& matcher: opts.fixes_matchers) {
+			hash = fnv1a(hash, matcher);
+		}
+		return std::filesystem::path{git_repository_path(&repo)} / "list-fixes" / std::format("fixes-index-{:016x}", hash);
+	}
+
+	git_oid toOid(const unsigned char (&raw)[20])
+	{
+		git_oid result;
+		std::memcpy(result.id, raw, sizeof(raw));
+		return result;
+	}
+
+	bool entryLess(const FixesIndex::Entry& left, const FixesIndex::Entry& right)
+	{
+		int r = std::memcmp(left.referenced, right.referenced, sizeof(left.referenced));
+		return r != 0 ? r < 0 : std::memcmp(left.fixing, right.fixing, sizeof(left.fixing)) < 0;
+	}
+
+	std::vector<FixesIndex::Entry> merge(std::span<const FixesIndex::Entry> left, std::span<const FixesIndex::Entry> right)
+	{
+		std::vector<FixesIndex::Entry> result(left.size() + right.size());
+		std::ranges::merge(left, right, result.begin(), entryLess);
+		return result;
+	}
+
+	void write(
+		const std::filesystem::path& path, const std::vector<git_oid>& tips, const std::vector<FixesIndex::Entry>& entries,
+		std::uint64_t baseKey)
+	{
+		std::filesystem::create_directories(path.parent_path());
+		std::filesystem::path temporaryPath{path};
+		temporaryPath += ".tmp";
+		{
+			std::ofstream file{temporaryPath, std::ios::binary | std::ios::trunc};
+			Header header{};
+			std::memcpy(header.magic, magic, sizeof(magic));
+			header.tipCount = static_cast<std::uint32_t>(tips.size());
+			header.entryCount = entries.size();
+			header.baseKey = baseKey;
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			for (const git_oid& tip: tips) {
+				file.write(reinterpret_cast<const char*>(tip.id), sizeof(FixesIndex::Entry::referenced));
+			}
+			file.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(FixesIndex::Entry)));
+			if (!file.flush()) {
+				throw std::runtime_error(std::format("Could not write {}", temporaryPath.string()));
+			}
+		}
+		std::filesystem::rename(temporaryPath, path);
+	}
+
+	/**
+	 * @brief Entries of the commits reachable from the tips and not from the hidden commits, sorted
+	 */
+	std::vector<FixesIndex::Entry> scan(
+		git_repository& repo, const Options& opts, const std::vector<git_oid>& tips, const std::vector<git_oid>& hidden)
+	{
+		git_revwalk* walkPtr;
+		LibgitError::check(git_revwalk_new(&walkPtr, &repo));
+		std::unique_ptr<git_revwalk, git_revwalk_deleter> walk{walkPtr};
+		for (const git_oid& tip: tips) {
+			LibgitError::check(git_revwalk_push(walk.get(), &tip));
+		}
+		for (const git_oid& tip: hidden) {
+			LibgitError::check(git_revwalk_hide(walk.get(), &tip));
+		}
+
+		std::vector<FixesIndex::Entry> result;
+		ReferenceTokenizer tokenizer{opts.fixes_matchers, repo};
+		git_oid id;
+		while (!git_revwalk_next(&id, walk.get())) {
+			for (const Reference& ref: tokenizer(RawCommit{repo, id})) {
+				if (ref.kind == Reference::Kind::CherryPick) {
+					continue;
+				}
+				FixesIndex::Entry& entry = result.emplace_back();
+				std::memcpy(entry.referenced, ref.id.id, sizeof(entry.referenced));
+				std::memcpy(entry.fixing, id.id, sizeof(entry.fixing));
+				entry.kind = static_cast<std::uint8_t>(ref.kind);
+			}
+		}
+		std::ranges::sort(result, entryLess);
+		return result;
+	}
+} // namespace
+
+FixesIndex::Part FixesIndex::Part::open(const std::filesystem::path& path)
+{
+	Part result{.file = MappedFile{path}, .tips = {}, .entries = {}, .baseKey = 0};
+	std::span<const std::byte> data{result.file.data()};
+	Header header;
+	if (data.size() < sizeof(header)) {
+		throw std::runtime_error("Truncated fixes index");
+	}
+	std::memcpy(&header, data.data(), sizeof(header));
+	const std::size_t tipsSize = header.tipCount * sizeof(Entry::referenced);
+	if (std::memcmp(header.magic, magic, sizeof(magic)) ||
+	    data.size() != sizeof(header) + tipsSize + header.entryCount * sizeof(Entry)) {
+		throw std::runtime_error("Malformed fixes index");
+	}
+	data = data.subspan(sizeof(header));
+	for (std::uint32_t i = 0; i < header.tipCount; ++i) {
+		git_oid& tip = result.tips.emplace_back();
+		std::memcpy(tip.id, data.data() + i * sizeof(Entry::referenced), sizeof(Entry::referenced));
+	}
+	result.entries = {reinterpret_cast<const Entry*>(data.data() + tipsSize), header.entryCount};
+	result.baseKey = header.baseKey;
+	return result;
+}
+
+std::uint64_t FixesIndex::Part::key() const
+{
+	// the tips and the entry count change with every update
+	std::uint64_t hash{fnv1aOffsetBasis};
+	for (const git_oid& tip: tips) {
+		hash = fnv1a(hash, {reinterpret_cast<const char*>(tip.id), sizeof(tip.id)});
+	}
+	return fnv1a(hash, std::to_string(entries.size()));
+}
+
+FixesIndex::FixesIndex(Part base, std::optional<Part> delta)
+	: base_{std::move(base)}
+	, delta_{std::move(delta)}
+{
+}
+
+FixesIndex FixesIndex::update(git_repository& repo, const Options& opts)
+{
+	TraceSpan span{"update fixes index"};
+	const std::filesystem::path path{indexPath(repo, opts)};
+	std::filesystem::path deltaPath{path};
+	deltaPath += ".delta";
+	auto openIndex = [&]() {
+		Part base{Part::open(path)};
+		std::optional<Part> delta;
+		if (std::filesystem::exists(deltaPath)) {
+			try {
+				delta.emplace(Part::open(deltaPath));
+			} catch (std::runtime_error&) {
+			}
+			// left over from before the base was rewritten
+			if (delta && delta->baseKey != base.key()) {
+				delta.reset();
+			}
+		}
+		return FixesIndex{std::move(base), std::move(delta)};
+	};
+
+	std::vector<git_oid> tips;
+	for (const std::string& source: opts.sources) {
+		tips.push_back(resolve_commit(repo, source));
+	}
+
+	std::optional<FixesIndex> previous;
+	if (std::filesystem::exists(path)) {
+		try {
+			previous.emplace(openIndex());
+		} catch (std::runtime_error&) {
+		}
+	}
+	if (previous && previous->tips() == tips) {
+		return std::move(*previous);
+	}
+	auto isAncestor = [&repo](const git_oid& ancestor, const git_oid& descendant) {
+		return ancestor == descendant || git_graph_descendant_of(&repo, &descendant, &ancestor) == 1;
+	};
+	if (!previous || previous->tips().size() != tips.size() ||
+	    !std::ranges::all_of(std::views::zip(previous->tips(), tips), [&](const auto& pair) {
+		    return isAncestor(std::get<0>(pair), std::get<1>(pair));
+	    })) {
+		previous.reset();
+		write(path, tips, scan(repo, opts, tips, {}), 0);
+		std::filesystem::remove(deltaPath);
+		return openIndex();
+	}
+
+	// the rest of the history is indexed already, the new entries go to the delta
+	std::vector<Entry> added{scan(repo, opts, tips, previous->tips())};
+	std::vector<Entry> delta{previous->delta_ ? merge(previous->delta_->entries, added) : std::move(added)};
+	if (delta.size() * deltaRatio > previous->base_.entries.size()) {
+		std::vector<Entry> all{merge(previous->base_.entries, delta)};
+		previous.reset();
+		write(path, tips, all, 0);
+		std::filesystem::remove(deltaPath);
+	} else {
+		const std::uint64_t baseKey{previous->base_.key()};
+		previous.reset();
+		write(deltaPath, tips, delta, baseKey);
+	}
+	return openIndex();
+}
+
+std::vector<FixesIndex::Entry> FixesIndex::find(const git_oid& referenced) const
+{
+	auto byReferenced = [](const Entry& entry) { return toOid(entry.referenced); };
+	std::vector<Entry> result;
+	for (std::span<const Entry> entries: {base_.entries, delta_ ? delta_->entries : std::span<const Entry>{}}) {
+		auto [first, last] = std::ranges::equal_range(entries, referenced, std::less<>{}, byReferenced);
+		result.insert(result.end(), first, last);
+	}
+	return result;
+}
+
+std::vector<CommitWithReferences> fixes_for(git_repository& repo, const Options& opts)
+{
+	FixesIndex index{FixesIndex::update(repo, opts)};
+
+	git_revspec revspec;
+	LibgitError::check(git_revparse(&revspec, &repo, opts.fixes_for.c_str()));
+	std::unique_ptr<git_object, void (*)(git_object*)> from{revspec.from, &git_object_free};
+	std::unique_ptr<git_object, void (*)(git_object*)> to{revspec.to, &git_object_free};
+
+	std::deque<git_oid> queried;
+	if (revspec.flags & GIT_REVSPEC_SINGLE) {
+		queried.push_back(resolve_commit(repo, opts.fixes_for));
+	} else {
+		git_revwalk* walkPtr;
+		LibgitError::check(git_revwalk_new(&walkPtr, &repo));
+		std::unique_ptr<git_revwalk, git_revwalk_deleter> walk{walkPtr};
+		const git_oid* fromId = git_object_id(from.get());
+		const git_oid* toId = git_object_id(to.get());
+		LibgitError::check(git_revwalk_push(walk.get(), toId));
+		if (revspec.flags & GIT_REVSPEC_MERGE_BASE) {
+			// A...B, the commits of either side that are not on the other one
+			LibgitError::check(git_revwalk_push(walk.get(), fromId));
+			git_oidarray bases{};
+			if (int error = git_merge_bases(&bases, &repo, fromId, toId); error != GIT_ENOTFOUND) {
+				// unrelated histories have nothing in common
+				LibgitError::check(error);
+			}
+			for (const git_oid& base: std::span{bases.ids, bases.count}) {
+				if (int error = git_revwalk_hide(walk.get(), &base); error) {
+					git_oidarray_dispose(&bases);
+					LibgitError::check(error);
+				}
+			}
+			git_oidarray_dispose(&bases);
+		} else {
+			LibgitError::check(git_revwalk_hide(walk.get(), fromId));
+		}
+		git_oid id;
+		while (!git_revwalk_next(&id, walk.get())) {
+			queried.push_back(id);
+		}
+	}
+
+	// fixes of the fixes are needed as well
+	std::vector<git_oid> order;
+	std::unordered_map<git_oid, std::vector<Reference>, OidHash> found;
+	std::unordered_set<git_oid, OidHash> seen{queried.begin(), queried.end()};
+	while (!queried.empty()) {
+		const git_oid referenced{queried.front()};
+		queried.pop_front();
+		for (const FixesIndex::Entry& entry: index.find(referenced)) {
+			const git_oid fixing{toOid(entry.fixing)};
+			auto [references, inserted] = found.try_emplace(fixing);
+			if (inserted) {
+				order.push_back(fixing);
+			}
+			references->second.push_back({.id = referenced, .kind = static_cast<Reference::Kind>(entry.kind)});
+			if (seen.insert(fixing).second) {
+				queried.push_back(fixing);
+			}
+		}
+	}
+
+	std::vector<CommitWithReferences> result;
+	for (const git_oid& id: order) {
+		result.emplace_back(repo, id, std::move(found[id]));
+	}
+	return result;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "commit.hxx"
+#include "mapped-file.hxx"
+
+#include <git2/types.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+struct Options;
+
+/**
+ * @brief Persistent index from the referenced commits to the commits that fix or revert them
+ *
+ * Covers the whole history of the source tips. A file holds a header, the indexed tips and the entries sorted by
+ * the referenced commit id, so it is searched in place once mapped into memory. The entries of the commits added
+ * since the base file was written go to a smaller delta file, which is merged into the base once it grows. The byte
+ * order is the native one, the index is a local cache.
+ */
+class FixesIndex {
+public:
+	struct Entry {
+		unsigned char referenced[20];
+		unsigned char fixing[20];
+		// Reference::Kind
+		std::uint8_t kind;
+		std::uint8_t reserved[3];
+	};
+
+	/**
+	 * @brief Opens the index, bringing it up to date with the source tips first
+	 *
+	 * Only the commits added since the last update are read, unless the history was rewritten.
+	 */
+	static FixesIndex update(git_repository& repo, const Options& opts);
+
+	std::vector<Entry> find(const git_oid& referenced) const;
+
+private:
+	struct Part {
+		MappedFile file;
+		std::vector<git_oid> tips;
+		std::span<const Entry> entries;
+		// key of the base a delta extends
+		std::uint64_t baseKey;
+
+		/**
+		 * @brief Maps and checks the file, throws std::runtime_error if it is malformed
+		 */
+		static Part open(const std::filesystem::path& path);
+		std::uint64_t key() const;
+	};
+
+	FixesIndex(Part base, std::optional<Part> delta);
+
+	const std::vector<git_oid>& tips() const { return delta_ ? delta_->tips : base_.tips; }
+
+	Part base_;
+	std::optional<Part> delta_;
+};
+
+/**
+ * @brief Fixes and reverts of the commits in opts.fixes_for, and their fixes in turn, looked up in the index
+ */
+std::vector<CommitWithReferences> fixes_for(git_repository& repo, const Options& opts);
@@ -2,254 +2,1050 @@
 
 #include "commit.hxx"
 #include "config.hxx"
+#include "equivalence.hxx"
 #include "filters.hxx"
-#include "tag-set.hxx"
+#include "reachability.hxx"
+#include "scan-pipeline.hxx"
+#include "scan-state.hxx"
+#include "subject-index.hxx"
+#include "trace.hxx"
 #include "utility.hxx"
 
+#include <git2/common.h>
+#include <git2/graph.h>
 #include <git2/merge.h>
+#include <git2/odb.h>
+#include <git2/oidarray.h>
 #include <git2/repository.h>
-#include <git2/revparse.h>
 #include <git2/revwalk.h>
 
 #include <algorithm>
-#include <cassert>
-#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <format>
+#include <functional>
+#include <limits>
 #include <memory>
 #include <ranges>
+#include <span>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
 
-template <typename T>
-struct branch_merge_info: std::pair<std::vector<T>, std::vector<T>> {
-	T merge_base;
+struct BranchTips {
+	git_oid target;
+	std::vector<git_oid> sources;
 };
 
-using branch_merge_info_oid = branch_merge_info<git_oid>;
+static BranchTips resolveTips(git_repository& repo, const Options& opts)
+{
+	if (opts.sources.empty()) {
+		throw std::runtime_error("No source revision given");
+	}
 
-struct git_object_deleter {
-	void operator()(git_object* object)
-	{
-		if (object) {
-			git_object_free(object);
-		}
+	BranchTips result{.target = resolve_commit(repo, opts.revision), .sources = {}};
+	for (const std::string& source: opts.sources) {
+		result.sources.push_back(resolve_commit(repo, source));
 	}
-};
+	return result;
+}
 
-git_object* gitRevparseSingle(git_repository& repo, const char* spec)
+/**
+ * @brief All the merge bases of the target with each source, sorted
+ *
+ * Criss-cross merges leave more than one per source. Every commit reachable from both the target and a source is
+ * reachable from one of these, so hiding them is all it takes to split the history into the two sides.
+ */
+static std::vector<git_oid> mergeBases(git_repository& repo, const BranchTips& tips)
 {
-	git_object* result;
-	LibgitError::check(git_revparse_single(&result, &repo, spec));
+	std::vector<git_oid> result;
+	for (const git_oid& source: tips.sources) {
+		git_oidarray bases;
+		if (git_merge_bases(&bases, &repo, &tips.target, &source)) {
+			throw std::runtime_error("Could not find merge base");
+		}
+		std::ranges::copy(std::span{bases.ids, bases.count}, std::back_inserter(result));
+		git_oidarray_dispose(&bases);
+	}
+	std::ranges::sort(result, std::less<>{});
+	result.erase(std::ranges::unique(result).begin(), result.end());
 	return result;
 }
 
-static branch_merge_info_oid load_commits(git_repository& repo, const std::string& first, const std::string& second)
+/**
+ * @brief The merge bases common to the target and all the sources, sorted
+ *
+ * Like `git merge-base --octopus --all`. The target range goes down to these: a source forking off the target
+ * earlier than another one still needs the target commits in between, its picks and reverts among them.
+ */
+static std::vector<git_oid> commonMergeBases(git_repository& repo, const BranchTips& tips)
 {
-	std::unique_ptr<git_object, git_object_deleter> firstObject{gitRevparseSingle(repo, first.c_str())};
-	std::unique_ptr<git_object, git_object_deleter> secondObject{gitRevparseSingle(repo, second.c_str())};
-
-	branch_merge_info_oid result;
-	int r =
-		git_merge_base(&result.merge_base, &repo, git_object_id(firstObject.get()), git_object_id(secondObject.get()));
-	if (r) {
-		throw std::runtime_error("Could not find merge base");
+	std::vector<git_oid> result{tips.target};
+	for (const git_oid& source: tips.sources) {
+		std::vector<git_oid> next;
+		for (const git_oid& base: result) {
+			git_oidarray bases;
+			if (git_merge_bases(&bases, &repo, &base, &source)) {
+				throw std::runtime_error("Could not find merge base");
+			}
+			std::ranges::copy(std::span{bases.ids, bases.count}, std::back_inserter(next));
+			git_oidarray_dispose(&bases);
+		}
+		std::ranges::sort(next, std::less<>{});
+		next.erase(std::ranges::unique(next).begin(), next.end());
+		result = std::move(next);
 	}
+	return result;
+}
 
-	git_revwalk* walk;
-	LibgitError::check(git_revwalk_new(&walk, &repo));
+/**
+ * @brief Commits reachable from any of the pushed commits and from none of the hidden ones, the newest first
+ *
+ * The order is topological, so a commit comes before all of its parents.
+ */
+static std::vector<git_oid> walkDifference(
+	git_repository& repo, const std::vector<git_oid>& push, const std::vector<git_oid>& hide)
+{
+	git_revwalk* walkPtr;
+	LibgitError::check(git_revwalk_new(&walkPtr, &repo));
+	std::unique_ptr<git_revwalk, git_revwalk_deleter> walk{walkPtr};
+	LibgitError::check(git_revwalk_sorting(walk.get(), GIT_SORT_TOPOLOGICAL | GIT_SORT_TIME));
 
-	LibgitError::check(git_revwalk_push(walk, git_object_id(firstObject.get())));
-	LibgitError::check(git_revwalk_push(walk, &result.merge_base));
-	LibgitError::check(git_revwalk_hide(walk, &result.merge_base));
+	for (const git_oid& id: push) {
+		LibgitError::check(git_revwalk_push(walk.get(), &id));
+	}
+	for (const git_oid& id: hide) {
+		LibgitError::check(git_revwalk_hide(walk.get(), &id));
+	}
 
+	std::vector<git_oid> result;
 	git_oid oid;
-	while (!git_revwalk_next(&oid, walk)) {
-		result.first.push_back(oid);
+	while (!git_revwalk_next(&oid, walk.get())) {
+		result.push_back(oid);
 	}
+	return result;
+}
 
-	LibgitError::check(git_revwalk_reset(walk));
-	LibgitError::check(git_revwalk_push(walk, git_object_id(secondObject.get())));
-	LibgitError::check(git_revwalk_push(walk, &result.merge_base));
-	LibgitError::check(git_revwalk_hide(walk, &result.merge_base));
-	while (!git_revwalk_next(&oid, walk)) {
-		result.second.push_back(oid);
+/**
+ * @brief Commits of the target side (second) and of the source side (first), the newest first
+ */
+struct BranchRange: std::pair<std::vector<git_oid>, std::vector<git_oid>> {};
+
+/**
+ * @brief Walks both sides of the range, the sources down to their merge bases with the target and the target
+ * down to the bases common to all of them
+ *
+ * These are two walks, one per side, each hiding the bases of its side. A commit shared by several sources is
+ * listed only once. The full and the incremental loads share this, the latter also hides the tips of the previous
+ * run.
+ */
+static BranchRange walkRange(
+	git_repository& repo,
+	const BranchTips& tips,
+	const std::vector<git_oid>& sourceBases,
+	const std::vector<git_oid>& targetBases,
+	const BranchTips* previous = nullptr)
+{
+	TraceSpan span{"load_commits"};
+	std::vector<git_oid> hiddenTarget{targetBases};
+	std::vector<git_oid> hiddenSources{sourceBases};
+	if (previous) {
+		hiddenTarget.push_back(previous->target);
+		std::ranges::copy(previous->sources, std::back_inserter(hiddenSources));
 	}
 
-	git_revwalk_free(walk);
+	BranchRange result;
+	result.first = walkDifference(repo, tips.sources, hiddenSources);
+	result.second = walkDifference(repo, {tips.target}, hiddenTarget);
 	return result;
 }
 
-std::vector<Reference> toReferencesArray(const std::vector<git_oid>& ids, Reference::Kind kind)
+void loadOptions(Options& options, git_repository& repo)
 {
-	std::vector<Reference> result;
-	result.reserve(ids.size());
-	std::ranges::transform(
-		ids, std::back_inserter(result), [kind](const git_oid& id) { return Reference{.id = id, .kind = kind}; });
-	return result;
+	Config config{repo};
+
+	if (std::vector<std::string> fixes = config.readMultiString("list-fixes.fixesMatcher"); !fixes.empty()) {
+		options.fixes_matchers = std::move(fixes);
+	}
+
+	if (std::vector<std::string> tags = config.readMultiString("list-fixes.tagMatcher"); !tags.empty()) {
+		options.tagMatchers = std::move(tags);
+	}
+
+	if (std::optional<std::string> trailer = config.readString("list-fixes.identityTrailer")) {
+		options.identity_trailer = std::move(*trailer);
+	}
+
+	if (std::optional<std::int64_t> size = config.readInt64("list-fixes.cacheMaxSize")) {
+		options.cache_max_size = *size;
+	}
+	if (std::optional<std::int64_t> size = config.readInt64("list-fixes.packWindowSize"); size && *size > 0) {
+		options.pack_window_size = static_cast<std::size_t>(*size);
+	}
+	if (std::optional<std::int64_t> size = config.readInt64("list-fixes.packMappedLimit"); size && *size > 0) {
+		options.pack_mapped_limit = static_cast<std::size_t>(*size);
+	}
 }
 
-bool containsAll(const std::vector<git_oid>& ids, const std::vector<git_oid>& references)
+void applyLibgitOptions(const Options& options)
 {
-	return std::ranges::all_of(references, [&ids](const git_oid& ref) { return std::ranges::contains(ids, ref); });
+	if (options.cache_max_size) {
+		LibgitError::check(git_libgit2_opts(GIT_OPT_SET_CACHE_MAX_SIZE, static_cast<ssize_t>(*options.cache_max_size)));
+	} else if (options.max_memory) {
+		// the commits are not looked at again once scanned, there is little use in caching them
+		LibgitError::check(git_libgit2_opts(GIT_OPT_SET_CACHE_MAX_SIZE, static_cast<ssize_t>(options.max_memory / 4)));
+	}
+	if (options.pack_window_size) {
+		LibgitError::check(git_libgit2_opts(GIT_OPT_SET_MWINDOW_SIZE, *options.pack_window_size));
+	}
+	if (options.pack_mapped_limit) {
+		LibgitError::check(git_libgit2_opts(GIT_OPT_SET_MWINDOW_MAPPED_LIMIT, *options.pack_mapped_limit));
+	}
 }
 
-bool containsAny(const std::vector<git_oid>& ids, const std::vector<git_oid>& references)
+struct FixesScanner::State {
+	State(const Options& options, git_repository& repository, const std::vector<git_oid>& blacklistedIds);
+
+	void loadFull(const BranchTips& tips);
+	bool loadIncremental(const BranchTips& tips);
+	void loadShards(const std::vector<std::filesystem::path>& paths);
+	TargetRecord scanTarget(const git_oid& id) const;
+	void addTarget(TargetRecord record);
+	void scan(SourceRecord& record) const;
+	bool judge(std::size_t index);
+	bool expired() const;
+	void cutShort();
+	void startPipeline();
+	void extractNewestFirst();
+	void resolveNewestFirst();
+	void advance();
+	bool held(std::size_t index);
+	void findReverts();
+	std::optional<bool> existsInTarget(const git_oid& id);
+	std::optional<bool> reachableFromTarget(const git_oid& id);
+	bool pickedByIdentity(const git_oid& id);
+	bool link(const SourceRecord& record);
+	void select(std::size_t index);
+	void markTargetReverts();
+	void annihilate(const git_oid& reverter, const std::vector<git_oid>& revertees);
+
+	const Options& opts;
+	git_repository& repo;
+	const std::vector<git_oid>& blacklist;
+
+	// resolves the fixes references by their subjects when the ids do not resolve
+	std::shared_ptr<SubjectIndex> subjects;
+	SourceScanner scanner;
+	// for the commits where only the references git itself writes matter
+	ReferenceTokenizer builtinTokenizer;
+
+	ScanState data;
+	std::unique_ptr<ReachabilityIndex> targetAncestors;
+	std::unordered_set<git_oid, OidHash> sourceIds;
+
+	// some of the fixes might be already cherry-picked, possibly through other branches, and the same fix might
+	// come from several source branches, so the commits are compared by their equivalence classes
+	enum : CommitEquivalence::Marks {
+		InTarget = 1,
+		Selected = 2,
+		Blacklisted = 4,
+		// the target reverted the change
+		Reverted = 8,
+	};
+	CommitEquivalence equivalence;
+	// commits by their patch ids, when those are compared
+	std::unordered_map<git_oid, git_oid, OidHash> patchIds;
+	// commits by their identity trailers, when those are compared
+	std::unordered_map<std::string, git_oid> identities;
+	// selected commits, including those cancelled out by a selected revert
+	std::unordered_set<git_oid, OidHash> selected;
+	// indices of the selected commits that are not handed out yet, in the order of selection
+	std::deque<std::size_t> queue;
+
+	// the source commits are analyzed from the oldest one, this is the number of those analyzed already
+	std::size_t analyzed{0};
+	// when the caller may stop early, source commits reverted later in the source range are held in the queue
+	// until all their reverts are analyzed, otherwise everything is held until the end of the source range
+	bool lookahead;
+	// the reverts ahead of the analysis are looked for once the first selected commit is about to be handed out
+	bool revertsFound{false};
+	std::unordered_map<git_oid, std::vector<git_oid>, OidHash> sourceReverts;
+	std::unordered_map<git_oid, std::size_t, OidHash> pendingReverters;
+
+	std::optional<std::chrono::steady_clock::time_point> deadline;
+	// set when the deadline cut the analysis short
+	std::optional<ScanProgress> progress;
+	// the deadline expired while the target side was loaded, nothing can be judged and the state is not saved
+	bool targetIncomplete{false};
+
+	// scans the commits left unscanned ahead of the judgement, in their order, or from the newest one until the
+	// deadline
+	std::unique_ptr<ScanPipeline> pipeline;
+};
+
+namespace {
+	// approximate memory taken by a visited commit in the reachability index
+	constexpr std::size_t visitedEntryCost{64};
+	// below that the worker threads would cost more than they save
+	constexpr std::size_t pipelineThreshold{64};
+
+	std::vector<git_oid> revertsOf(const std::vector<Reference>& references)
+	{
+		std::vector<git_oid> result;
+		for (const Reference& ref: references) {
+			if (ref.kind == Reference::Kind::Revert) {
+				result.push_back(ref.id);
+			}
+		}
+		return result;
+	}
+} // namespace
+
+FixesScanner::State::State(const Options& options, git_repository& repository, const std::vector<git_oid>& blacklistedIds)
+	: opts{options}
+	, repo{repository}
+	, blacklist{blacklistedIds}
+	, subjects{ReferenceTokenizer::capturesSubjects(opts.fixes_matchers) ? std::make_shared<SubjectIndex>() : nullptr}
+	, scanner{opts, repo, subjects}
+	, builtinTokenizer{{}, repo}
+	, lookahead{opts.limit > 0 || opts.exists}
 {
-	return std::ranges::any_of(references, [&ids](const git_oid& ref) { return std::ranges::contains(ids, ref); });
+	if (opts.deadline) {
+		deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds{opts.deadline};
+		if (subjects) {
+			subjects->setDeadline(*deadline);
+		}
+	}
+
+	if (!opts.merge_shards.empty()) {
+		loadShards(opts.merge_shards);
+	} else if (BranchTips tips{resolveTips(repo, opts)}; !opts.incremental || !loadIncremental(tips)) {
+		loadFull(tips);
+	}
+	if (subjects) {
+		// read on the first reference that needs it, those are rare
+		std::vector<git_oid> ids;
+		ids.reserve(data.sourceCommits.size());
+		for (const SourceRecord& record: data.sourceCommits) {
+			ids.push_back(record.id);
+		}
+		subjects->setPendingSources(std::move(ids));
+	}
+
+	for (const TargetRecord& record: data.targetCommits) {
+		equivalence.mark(record.id, InTarget);
+		for (const git_oid& origin: record.origins) {
+			equivalence.join(record.id, origin);
+		}
+	}
+	markTargetReverts();
+	for (const TargetRecord& record: data.targetCommits) {
+		if (!record.identity.empty()) {
+			identities.try_emplace(record.identity, record.id);
+		}
+	}
+	for (const TargetRecord& record: data.targetCommits) {
+		if (record.patchId) {
+			patchIds.emplace(*record.patchId, record.id);
+		}
+	}
+	if (targetIncomplete) {
+		// with a part of the target side missing, no fix can be confirmed
+		cutShort();
+		progress->undecided = progress->scanned;
+		analyzed = data.sourceCommits.size();
+		return;
+	}
+	for (const git_oid& id: blacklist) {
+		equivalence.mark(id, Blacklisted);
+	}
+	for (const SourceRecord& record: data.sourceCommits) {
+		sourceIds.insert(record.id);
+	}
+	const std::size_t maxResident =
+		opts.max_memory ? opts.max_memory / 2 / visitedEntryCost : std::numeric_limits<std::size_t>::max();
+	targetAncestors = std::make_unique<ReachabilityIndex>(repo, data.target, maxResident);
+
+	startPipeline();
+	if (deadline) {
+		extractNewestFirst();
+		resolveNewestFirst();
+	} else if (opts.max_memory && !lookahead) {
+		// with the visited commits spilled, one merge-join beats searching the files for each reference, so the
+		// source commits are all scanned before the judgement to collect the references
+		{
+			TraceSpan span{"scan source commits"};
+			for (SourceRecord& record: data.sourceCommits) {
+				if (record.scanned) {
+					continue;
+				}
+				if (pipeline) {
+					record = pipeline->next(record.id);
+				} else {
+					scan(record);
+				}
+			}
+			pipeline.reset();
+		}
+
+		std::vector<git_oid> references;
+		auto collect = [this, &references](const git_oid& id) {
+			if (!sourceIds.contains(id) && !data.reachable.contains(id)) {
+				references.push_back(id);
+			}
+		};
+		for (const SourceRecord& record: data.sourceCommits) {
+			std::ranges::for_each(record.origins, collect);
+			if (record.accepted) {
+				std::ranges::for_each(record.references, collect, &Reference::id);
+			}
+		}
+		std::ranges::sort(references, std::less<>{});
+		references.erase(std::ranges::unique(references).begin(), references.end());
+		TraceSpan span{"resolve reachability"};
+		const std::vector<bool> verdicts{targetAncestors->reachable(references)};
+		for (std::size_t i = 0; i < references.size(); ++i) {
+			data.reachable.emplace(references[i], verdicts[i]);
+		}
+	}
 }
 
-void collectReferences(
-	std::vector<git_oid>& destination, git_repository& repo, const std::vector<git_oid>& commits,
-	const ReferenceExtractingFilter& filter)
+void FixesScanner::State::loadFull(const BranchTips& tips)
 {
-	auto inserter{std::back_inserter(destination)};
-	for (const git_oid& id: commits) {
-		Commit c{repo, id};
-		std::ranges::copy(filter.extract(c), inserter);
+	data = ScanState{};
+	data.target = tips.target;
+	data.sources = tips.sources;
+	data.mergeBases = mergeBases(repo, tips);
+	data.commonBases = commonMergeBases(repo, tips);
+	BranchRange commits{walkRange(repo, tips, data.mergeBases, data.commonBases)};
+
+	TraceSpan span{"scan target commits"};
+	for (const git_oid& id: commits.second) {
+		if (expired()) {
+			targetIncomplete = true;
+			break;
+		}
+		addTarget(scanTarget(id));
+	}
+	for (const git_oid& id: std::ranges::reverse_view{commits.first}) {
+		data.sourceCommits.push_back(SourceRecord{.id = id});
 	}
 }
 
-std::vector<git_oid> removeReferencedCommits(
-	git_repository& repo, const std::vector<git_oid>& commits, const ReferenceExtractingFilter& filter)
+/**
+ * @brief Loads the state of the previous run and brings it up to date with the new tips
+ *
+ * Only the commits added since the previous run are walked, the new target commits are scanned right away and the
+ * new source ones are queued for the analysis.
+ *
+ * @return false if there is no usable state or the history was rewritten since
+ */
+bool FixesScanner::State::loadIncremental(const BranchTips& tips)
 {
-	std::vector<git_oid> referenses;
-	auto inserter{std::back_inserter(referenses)};
-	for (const git_oid& id: commits) {
-		Commit c{repo, id};
-		std::ranges::copy(filter.extract(c), inserter);
+	TraceSpan span{"load incremental state"};
+	std::optional<ScanState> previous{ScanState::load(scanStatePath(repo, opts))};
+	if (!previous || previous->sources.size() != tips.sources.size()) {
+		return false;
 	}
-	std::vector<git_oid> result;
-	std::ranges::remove_copy_if(commits, std::back_inserter(result), [&referenses](const git_oid& id) {
-		return std::ranges::contains(referenses, id);
-	});
-	return result;
+
+	auto isAncestor = [this](const git_oid& ancestor, const git_oid& descendant) {
+		return ancestor == descendant || git_graph_descendant_of(&repo, &descendant, &ancestor) == 1;
+	};
+	if (!isAncestor(previous->target, tips.target)) {
+		return false;
+	}
+	for (const auto& [previousSource, source]: std::views::zip(previous->sources, tips.sources)) {
+		if (!isAncestor(previousSource, source)) {
+			return false;
+		}
+	}
+
+	data = std::move(*previous);
+
+	const std::vector<git_oid> bases{mergeBases(repo, tips)};
+	const std::vector<git_oid> common{commonMergeBases(repo, tips)};
+
+	// commits the target can reach now, but could not before
+	std::unordered_set<git_oid, OidHash> nowInTarget;
+	if (bases != data.mergeBases) {
+		// merges moved the merge bases, commits below them are not part of either range any more
+		for (const git_oid& id: walkDifference(repo, bases, data.mergeBases)) {
+			nowInTarget.insert(id);
+		}
+		std::erase_if(data.targetCommits, [&nowInTarget](const TargetRecord& r) { return nowInTarget.contains(r.id); });
+		std::erase_if(data.sourceCommits, [&nowInTarget](const SourceRecord& r) { return nowInTarget.contains(r.id); });
+	}
+	if (common != data.commonBases) {
+		// the target commits below the new common bases are left out of the range, as in a full load
+		std::unordered_set<git_oid, OidHash> below;
+		for (const git_oid& id: walkDifference(repo, common, data.commonBases)) {
+			below.insert(id);
+		}
+		std::erase_if(data.targetCommits, [&below](const TargetRecord& r) { return below.contains(r.id); });
+	}
+
+	const BranchTips previousTips{.target = data.target, .sources = data.sources};
+	if (subjects) {
+		// the target commits of the previous runs are not scanned again
+		subjects->setPendingTarget(data.target, common);
+	}
+	BranchRange commits{walkRange(repo, tips, bases, common, &previousTips)};
+	for (const git_oid& id: commits.second) {
+		if (expired()) {
+			targetIncomplete = true;
+			break;
+		}
+		addTarget(scanTarget(id));
+		nowInTarget.insert(id);
+	}
+
+	for (auto& [id, isReachable]: data.reachable) {
+		isReachable = isReachable || nowInTarget.contains(id);
+	}
+
+	for (const git_oid& id: std::ranges::reverse_view{commits.first}) {
+		data.sourceCommits.push_back(SourceRecord{.id = id});
+	}
+
+	data.target = tips.target;
+	data.sources = tips.sources;
+	data.mergeBases = bases;
+	data.commonBases = common;
+	return true;
 }
 
-void loadOptions(Options& options, git_repository& repo)
+/**
+ * @brief Combines the records of the shards, each source commit is taken from the shard that scanned it
+ *
+ * The commits no shard scanned are scanned during the judgement as usual.
+ */
+void FixesScanner::State::loadShards(const std::vector<std::filesystem::path>& paths)
 {
-	Config config{repo};
+	TraceSpan span{"load shards"};
+	bool first{true};
+	for (const std::filesystem::path& path: paths) {
+		std::optional<ScanState> shard{ScanState::load(path)};
+		if (!shard) {
+			throw std::runtime_error(std::format("Could not read the shard file {}", path.string()));
+		}
+		if (first) {
+			data = std::move(*shard);
+			first = false;
+			continue;
+		}
 
-	if (std::vector<std::string> fixes = config.readMultiString("list-fixes.fixesMatcher"); !fixes.empty()) {
-		options.fixes_matchers = std::move(fixes);
+		if (shard->target != data.target || shard->sources != data.sources || shard->mergeBases != data.mergeBases ||
+		    shard->commonBases != data.commonBases || shard->sourceCommits.size() != data.sourceCommits.size()) {
+			throw std::runtime_error(std::format("The shard file {} belongs to a different run", path.string()));
+		}
+		for (auto&& [record, shardRecord]: std::views::zip(data.sourceCommits, shard->sourceCommits)) {
+			if (record.id != shardRecord.id) {
+				throw std::runtime_error(std::format("The shard file {} belongs to a different run", path.string()));
+			}
+			if (!record.scanned && shardRecord.scanned) {
+				record = std::move(shardRecord);
+			}
+		}
+		data.reachable.merge(shard->reachable);
+	}
+	if (subjects) {
+		// the shards scanned the target commits
+		subjects->setPendingTarget(data.target, data.commonBases);
 	}
+}
 
-	if (std::vector<std::string> tags = config.readMultiString("list-fixes.tagMatcher"); !tags.empty()) {
-		options.tagMatchers = std::move(tags);
+TargetRecord FixesScanner::State::scanTarget(const git_oid& id) const
+{
+	TargetRecord result{.id = id, .reverts = {}, .origins = {}};
+	RawCommit commit{repo, id};
+	for (const Reference& ref: builtinTokenizer(commit)) {
+		(ref.kind == Reference::Kind::CherryPick ? result.origins : result.reverts).push_back(ref.id);
+	}
+	if (!opts.identity_trailer.empty()) {
+		result.identity = identity_trailer(commit.message(), opts.identity_trailer).value_or(std::string{});
+	}
+	if (subjects) {
+		subjects->add(id, commit.summary());
+	}
+	if (opts.patch_ids) {
+		// kept in the state, the incremental runs only diff the new target commits
+		result.patchId = patch_id(repo, id);
+	}
+	return result;
+}
+
+void FixesScanner::State::addTarget(TargetRecord record)
+{
+	// within the memory budget, only the records with references are kept: the target commits themselves are
+	// found by the reachability check
+	if (!opts.max_memory || opts.patch_ids || !record.identity.empty() || !record.reverts.empty() || !record.origins.empty()) {
+		data.targetCommits.push_back(std::move(record));
 	}
 }
 
-std::vector<Commit> fixes(const Options& opts, git_repository& repo, const std::vector<git_oid>& blacklist)
+void FixesScanner::State::scan(SourceRecord& record) const
 {
-	branch_merge_info_oid commits{load_commits(repo, opts.source, opts.revision)};
+	scanner(record);
+}
 
-	RevertFilter revertFilter{repo};
-	std::vector<git_oid> targetToRemove{blacklist};
-	collectReferences(targetToRemove, repo, commits.second, revertFilter);
-	std::vector<git_oid> targets{commits.second};
-	targets.erase(
-		std::remove_if(
-			targets.begin(), targets.end(),
-			[&targetToRemove](const git_oid& id) { return std::ranges::contains(targetToRemove, id); }),
-		targets.end());
+/**
+ * @brief Whether the commit or a copy of it is in the target, nullopt if the deadline came before the answer
+ */
+std::optional<bool> FixesScanner::State::existsInTarget(const git_oid& id)
+{
+	if (equivalence.marks(id) & (InTarget | Selected)) {
+		return true;
+	}
 
-	// for the source branch we need only fixup commits, maybe filtered by other rules
-	// CompoundFilter sourceFilters{filterForSources(opts, repo)};
+	if (sourceIds.contains(id)) {
+		return false;
+	}
 
-	FixesFilter fixesFilter{opts.fixes_matchers, repo};
-	std::map<std::string, std::vector<std::string>> tagSet =
-		opts.tagSet.empty() ? std::map<std::string, std::vector<std::string>>{} : load_tag_set(opts.tagSet);
-	TagMatcher tagsMatcher{tagSet.empty() ? std::vector<std::string>{} : opts.tagMatchers, std::move(tagSet)};
+	std::optional<bool> reachable = reachableFromTarget(id);
+	if (reachable.value_or(false) || pickedByIdentity(id)) {
+		return true;
+	}
+	return reachable;
+}
 
-	// some of the fixes might be already cherry-picked
-	std::vector<git_oid>
-		cherryPickedToTarget;
-	collectReferences(cherryPickedToTarget, repo, commits.second, CherryPickedFilter{repo});
+/**
+ * @brief Whether a commit outside of both ranges has a copy in the target with the same identity trailer
+ */
+bool FixesScanner::State::pickedByIdentity(const git_oid& id)
+{
+	if (opts.identity_trailer.empty() || identities.empty()) {
+		return false;
+	}
+	// the header read tells a missing commit apart without inflating the object
+	git_odb* odb;
+	LibgitError::check(git_repository_odb(&odb, &repo));
+	std::size_t size;
+	git_object_t type;
+	const int error = git_odb_read_header(&size, &type, odb, &id);
+	git_odb_free(odb);
+	if (error || type != GIT_OBJECT_COMMIT) {
+		return false;
+	}
 
-	std::vector<Commit> commitsToCherryPick;
+	std::optional<std::string> identity{identity_trailer(RawCommit{repo, id}.message(), opts.identity_trailer)};
+	if (!identity) {
+		return false;
+	}
+	auto known = identities.find(*identity);
+	if (known == identities.end() || !(equivalence.marks(known->second) & InTarget)) {
+		return false;
+	}
+	equivalence.join(known->second, id);
+	return true;
+}
 
-	auto existsInTarget = [&](const git_oid& id) {
-		// TODO the next two check are only for debugging, can/to be removed
-		if (std::ranges::contains(cherryPickedToTarget, id)) {
-			return true;
+std::optional<bool> FixesScanner::State::reachableFromTarget(const git_oid& id)
+{
+	if (auto known = data.reachable.find(id); known != data.reachable.end()) {
+		return known->second;
+	}
+	std::optional<bool> result = deadline ? targetAncestors->reachable(id, *deadline) : targetAncestors->reachable(id);
+	if (result) {
+		data.reachable.emplace(id, *result);
+	}
+	return result;
+}
+
+void FixesScanner::State::select(std::size_t index)
+{
+	const SourceRecord& record = data.sourceCommits[index];
+	selected.insert(record.id);
+	equivalence.mark(record.id, Selected);
+	queue.push_back(index);
+}
+
+/**
+ * @brief Joins the source commit with the commits it was cherry-picked from and, optionally, with the commits
+ * having the same identity trailer or patch id
+ *
+ * @return false if the deadline came before all of those were known
+ */
+bool FixesScanner::State::link(const SourceRecord& record)
+{
+	bool complete{true};
+	for (const git_oid& origin: record.origins) {
+		equivalence.join(record.id, origin);
+		if (!sourceIds.contains(origin) && !(equivalence.marks(origin) & InTarget)) {
+			std::optional<bool> reachable = reachableFromTarget(origin);
+			complete = complete && reachable.has_value();
+			if (reachable.value_or(false)) {
+				equivalence.mark(origin, InTarget);
+			}
 		}
+	}
+	if (!record.identity.empty()) {
+		auto [known, inserted] = identities.try_emplace(record.identity, record.id);
+		if (!inserted) {
+			equivalence.join(known->second, record.id);
+		}
+	}
+	// only the commits that could be selected are worth a diff
+	if (opts.patch_ids && (record.tagged || record.accepted)) {
+		if (expired()) {
+			return false;
+		}
+		if (std::optional<git_oid> patch = patch_id(repo, record.id)) {
+			auto [known, inserted] = patchIds.try_emplace(*patch, record.id);
+			if (!inserted) {
+				equivalence.join(known->second, record.id);
+			}
+		}
+	}
+	return complete;
+}
 
-		if (std::ranges::contains(commits.second, id)) {
-			return true;
+/**
+ * @brief Marks the changes the target reverted, a revert that was reverted in turn does not count
+ */
+void FixesScanner::State::markTargetReverts()
+{
+	std::unordered_map<git_oid, std::vector<git_oid>, OidHash> reverters;
+	for (const TargetRecord& record: data.targetCommits) {
+		for (const git_oid& revertee: record.reverts) {
+			reverters[revertee].push_back(record.id);
 		}
+	}
+	if (reverters.empty()) {
+		return;
+	}
 
-		if (std::ranges::any_of(commitsToCherryPick, [&id](const Commit& c) { return c.id() == id; })) {
-			return true;
+	std::unordered_map<git_oid, bool, OidHash> reverted;
+	std::function<bool(const git_oid&)> isReverted = [&](const git_oid& id) {
+		auto known = reverted.find(id);
+		if (known != reverted.end()) {
+			return known->second;
 		}
+		auto found = reverters.find(id);
+		bool result = found != reverters.end() &&
+		              std::ranges::any_of(found->second, [&](const git_oid& reverter) { return !isReverted(reverter); });
+		reverted.emplace(id, result);
+		return result;
+	};
+	for (const auto& [revertee, ids]: reverters) {
+		if (isReverted(revertee)) {
+			equivalence.mark(revertee, Reverted);
+		}
+	}
+}
 
-		if (std::ranges::contains(commits.first, id)) {
-			return false;
+void FixesScanner::State::annihilate(const git_oid& reverter, const std::vector<git_oid>& revertees)
+{
+	TraceSpan span{"annihilate reverts"};
+	// a fix and everything that reverts it cancel out
+	std::erase_if(queue, [&](std::size_t index) {
+		const git_oid& id = data.sourceCommits[index].id;
+		return id == reverter || std::ranges::contains(revertees, id);
+	});
+}
+
+bool FixesScanner::State::held(std::size_t index)
+{
+	if (analyzed == data.sourceCommits.size()) {
+		return false;
+	}
+	if (!lookahead) {
+		return true;
+	}
+	if (!revertsFound) {
+		findReverts();
+	}
+	auto pending = pendingReverters.find(data.sourceCommits[index].id);
+	return pending != pendingReverters.end() && pending->second > 0;
+}
+
+/**
+ * @brief Finds the source commits not analyzed yet that revert other ones
+ *
+ * Whether a selected commit is reverted later is only known after reading the messages of all the commits after
+ * it, so the first commit handed out costs a read of the rest of the source range. Those reads only look for the
+ * revert references, the other commits after the stop are neither scanned nor judged.
+ */
+void FixesScanner::State::findReverts()
+{
+	TraceSpan span{"find reverts"};
+	revertsFound = true;
+	for (const SourceRecord& record: data.sourceCommits | std::views::drop(analyzed)) {
+		if (progress && !record.scanned) {
+			continue;
 		}
+		std::vector<git_oid> reverts{revertsOf(record.scanned ? record.references : builtinTokenizer(RawCommit{repo, record.id}))};
+		for (const git_oid& revertee: reverts) {
+			++pendingReverters[revertee];
+		}
+		if (!reverts.empty()) {
+			sourceReverts.emplace(record.id, std::move(reverts));
+		}
+	}
+}
 
+/**
+ * @return false if the deadline came before it was known whether the references hit the target
+ */
+bool FixesScanner::State::judge(std::size_t index)
+{
+	const SourceRecord& record = data.sourceCommits[index];
+	if (equivalence.marks(record.id) & Selected) {
+		return true;
+	}
+	if (record.tagged) {
+		select(index);
+		return true;
+	}
+	if (record.references.empty() || !record.accepted) {
 		return true;
+	}
+
+	bool decided{true};
+	auto hitsTarget = [this, &decided](const Reference& ref) {
+		std::optional<bool> exists = existsInTarget(ref.id);
+		decided = decided && exists.has_value();
+		// neither the fixes nor the reverts of a change the target reverted are needed
+		return exists.value_or(false) && !(equivalence.marks(ref.id) & Reverted);
 	};
+	if (std::ranges::any_of(record.references, hitsTarget)) {
+		select(index);
+		std::vector<git_oid> reverts{revertsOf(record.references)};
+		if (!reverts.empty() &&
+		    std::ranges::all_of(reverts, [this](const git_oid& revertee) { return selected.contains(revertee); })) {
+			annihilate(record.id, reverts);
+		}
+		return true;
+	}
+	return decided;
+}
 
-	CompoundFilter otherFilters{filterForSources(opts, repo)};
+bool FixesScanner::State::expired() const
+{
+	return deadline && std::chrono::steady_clock::now() >= *deadline;
+}
 
-	struct Revertion {
-		git_oid id;
-		std::vector<git_oid> reverts;
-	};
+/**
+ * @brief Records how far the analysis got, on the first time the deadline stops a part of it
+ */
+void FixesScanner::State::cutShort()
+{
+	if (progress) {
+		return;
+	}
+	progress = ScanProgress{
+		.scanned = static_cast<std::size_t>(std::ranges::count_if(data.sourceCommits, &SourceRecord::scanned)),
+		.total = data.sourceCommits.size(),
+		.undecided = 0,
+		.stoppedAt = std::nullopt};
+	auto unscanned = std::ranges::find_if(
+		std::ranges::reverse_view{data.sourceCommits}, [](const SourceRecord& record) { return !record.scanned; });
+	if (unscanned != std::ranges::reverse_view{data.sourceCommits}.end()) {
+		progress->stoppedAt = unscanned->id;
+	}
+}
 
-	std::vector<Revertion> revertingFixes;
+/**
+ * @brief Starts scanning the commits left unscanned in the worker threads, from the newest one under a deadline
+ */
+void FixesScanner::State::startPipeline()
+{
+	// a shard scans only its own slice
+	if (opts.jobs == 1 || opts.shards) {
+		return;
+	}
+	std::vector<git_oid> unscanned;
+	for (const SourceRecord& record: data.sourceCommits) {
+		if (!record.scanned) {
+			unscanned.push_back(record.id);
+		}
+	}
+	if (unscanned.size() < pipelineThreshold) {
+		return;
+	}
+	if (deadline) {
+		std::ranges::reverse(unscanned);
+	}
+	pipeline = std::make_unique<ScanPipeline>(opts, repo, std::move(unscanned), subjects);
+}
 
-	for (const git_oid& id: std::ranges::reverse_view{commits.first}) {
-		if (std::ranges::contains(blacklist, id) || std::ranges::contains(cherryPickedToTarget, id)) {
+/**
+ * @brief Scans the source commits from the newest one until the deadline
+ *
+ * The newest fixes are the ones found when the time runs out. The commits left unscanned are skipped by the
+ * judgement and, in the incremental mode, scanned by the next run.
+ */
+void FixesScanner::State::extractNewestFirst()
+{
+	TraceSpan span{"extract newest first"};
+	for (SourceRecord& record: std::ranges::reverse_view{data.sourceCommits}) {
+		if (record.scanned) {
 			continue;
 		}
-		Commit c{repo, id};
-		// std::clog << "Analyzing " << c.logFormat() << std::endl;
-		if (tagsMatcher(c)) {
-			commitsToCherryPick.push_back(std::move(c));
-			continue;
+		if (expired()) {
+			cutShort();
+			break;
 		}
-		std::vector<Reference> references{toReferencesArray(fixesFilter.extract(c), Reference::Kind::Fixes)};
-		std::vector<Reference> reverts;
-		std::ranges::copy(toReferencesArray(revertFilter.extract(c), Reference::Kind::Revert), std::back_inserter(reverts));
-		if (references.empty() && reverts.empty()) {
-			continue;
+		try {
+			if (pipeline) {
+				record = pipeline->next(record.id);
+			} else {
+				scan(record);
+			}
+		} catch (const DeadlineExpired&) {
+			// the subject index was not built in time
+			record = SourceRecord{.id = record.id};
+			cutShort();
+			break;
 		}
+	}
+	// nothing is scanned past the deadline
+	pipeline.reset();
+}
 
-		std::ranges::copy(reverts, std::back_inserter(references));
-
-		if (!otherFilters(c)) {
+/**
+ * @brief Resolves whether the references of the scanned commits hit the target, from the newest commit until the
+ * deadline
+ *
+ * The walk of the target history goes down from its tip and each step down costs more, so the references of the
+ * newest commits are the cheapest ones to resolve; the judgement from the oldest commit then finds them resolved.
+ * The references known without a walk, to target or source commits or resolved by a previous run, take no time
+ * and are judged in any case.
+ */
+void FixesScanner::State::resolveNewestFirst()
+{
+	TraceSpan span{"resolve newest first"};
+	auto resolved = [this](const git_oid& id) {
+		return sourceIds.contains(id) || (equivalence.marks(id) & InTarget) || reachableFromTarget(id).has_value();
+	};
+	for (const SourceRecord& record: std::ranges::reverse_view{data.sourceCommits}) {
+		if (!record.scanned) {
 			continue;
 		}
+		if (!std::ranges::all_of(record.origins, resolved)) {
+			return;
+		}
+		if (record.accepted && !std::ranges::all_of(record.references, resolved, &Reference::id)) {
+			return;
+		}
+	}
+}
 
-		if (std::ranges::any_of(references, [&](const Reference& ref) { return existsInTarget(ref.id); })) {
-			if (!reverts.empty()) {
-				Revertion revertion;
-				revertion.id = c.id();
-				std::ranges::transform(reverts, std::back_inserter(revertion.reverts), [](const Reference& r) { return r.id; });
-				revertingFixes.push_back(revertion);
-			}
-			commitsToCherryPick.push_back(std::move(c));
+void FixesScanner::State::advance()
+{
+	const std::size_t index = analyzed++;
+	SourceRecord& record = data.sourceCommits[index];
+
+	if (auto reverts = sourceReverts.find(record.id); reverts != sourceReverts.end()) {
+		for (const git_oid& revertee: reverts->second) {
+			--pendingReverters[revertee];
 		}
 	}
 
-	std::vector<Revertion> annihilatedRevertions;
-	for (const Revertion& reverter: revertingFixes) {
-		if (std::ranges::all_of(reverter.reverts, [&commitsToCherryPick](const git_oid& revertee) {
-				return std::ranges::contains(commitsToCherryPick, revertee, &Commit::id);
-			})) {
-			annihilatedRevertions.push_back(reverter);
+	if (!record.scanned && pipeline) {
+		// the pipeline scans every commit left unscanned, they are taken in order even if not needed
+		record = pipeline->next(record.id);
+	}
+	if (equivalence.marks(record.id) & (InTarget | Blacklisted)) {
+		return;
+	}
+	if (!record.scanned) {
+		if (progress) {
+			return;
 		}
+		scan(record);
+	}
+	const bool linked = link(record);
+	if (equivalence.marks(record.id) & (InTarget | Blacklisted)) {
+		return;
 	}
+	if (!linked || !judge(index)) {
+		// left for the next run, which finds more of the references resolved
+		cutShort();
+		++progress->undecided;
+	}
+}
+
+FixesScanner::FixesScanner(const Options& opts, git_repository& repo, const std::vector<git_oid>& blacklist)
+	: state_{std::make_unique<State>(opts, repo, blacklist)}
+{
+}
+
+FixesScanner::~FixesScanner() = default;
 
-	auto removeCommit = [](std::vector<Commit>& from, const git_oid& id) {
-		auto iter = std::ranges::find(from, id, &Commit::id);
-		if (iter != from.end()) {
-			from.erase(iter);
+std::optional<CommitWithReferences> FixesScanner::next()
+{
+	for (;;) {
+		if (!state_->queue.empty() && !state_->held(state_->queue.front())) {
+			const SourceRecord& record = state_->data.sourceCommits[state_->queue.front()];
+			state_->queue.pop_front();
+			return CommitWithReferences{state_->repo, record.id, record.references};
 		}
-	};
+		if (state_->analyzed == state_->data.sourceCommits.size()) {
+			return std::nullopt;
+		}
+		state_->advance();
+	}
+}
+
+std::optional<ScanProgress> FixesScanner::partial() const
+{
+	return state_->progress;
+}
 
-	for (const Revertion& reverter: annihilatedRevertions) {
-		for (const git_oid& revertee: reverter.reverts) {
-			removeCommit(commitsToCherryPick, revertee);
+namespace {
+	// independent of the platform, so that the shards can run on different machines
+	unsigned shardOf(const git_oid& id, unsigned shards)
+	{
+		const std::uint32_t value = static_cast<std::uint32_t>(id.id[0]) << 24 | static_cast<std::uint32_t>(id.id[1]) << 16 |
+		                            static_cast<std::uint32_t>(id.id[2]) << 8 | id.id[3];
+		return value % shards + 1;
+	}
+} // namespace
+
+void FixesScanner::writeShard(const std::filesystem::path& path)
+{
+	TraceSpan span{"scan shard"};
+	State& state = *state_;
+	for (SourceRecord& record: state.data.sourceCommits) {
+		if (record.scanned || shardOf(record.id, state.opts.shards) != state.opts.shard) {
+			continue;
+		}
+		state.scan(record);
+		// the reachability verdicts are the other expensive part of the judgement
+		if (record.accepted) {
+			for (const Reference& ref: record.references) {
+				if (!state.sourceIds.contains(ref.id)) {
+					state.reachableFromTarget(ref.id);
+				}
+			}
 		}
-		removeCommit(commitsToCherryPick, reverter.id);
 	}
+	state.data.save(path);
+}
 
-	return commitsToCherryPick;
+void FixesScanner::saveState() const
+{
+	if (state_->opts.incremental && !state_->targetIncomplete) {
+		state_->data.save(scanStatePath(state_->repo, state_->opts));
+	}
+}
+
+std::vector<CommitWithReferences> fixes(
+	const Options& opts, git_repository& repo, const std::vector<git_oid>& blacklist, std::optional<ScanProgress>* partial)
+{
+	FixesScanner scanner{opts, repo, blacklist};
+	std::vector<CommitWithReferences> result;
+	while (opts.limit == 0 || result.size() < opts.limit) {
+		std::optional<CommitWithReferences> fix{scanner.next()};
+		if (!fix) {
+			break;
+		}
+		result.push_back(std::move(*fix));
+	}
+	scanner.saveState();
+	if (partial) {
+		*partial = scanner.partial();
+	}
+	return result;
 }
@@ -4,14 +4,17 @@
 
 #include <git2/types.h>
 
+#include <cstdint>
 #include <filesystem>
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
 struct Options {
 	std::filesystem::path repo_path{"."};
 	std::string revision{"HEAD"};
-	std::string source{"master"};
+	std::vector<std::string> sources{"master"};
 	std::string author;
 	std::string ignore_file;
 	std::filesystem::path bl_file;
@@ -28,18 +31,106 @@ struct Options {
 	bool write_bl{false};
 	bool no_blacklist{false};
 	bool output_script{false};
+	// commits per `git cherry-pick` command of the script
+	std::size_t script_batch{64};
+	bool script_stdin{false};
+	bool check_apply{false};
+	bool exists{false};
+	bool incremental{false};
+	bool patch_ids{false};
+	// key of the trailer that identifies a change across the branches, e.g. Change-Id, none if empty
+	std::string identity_trailer;
+	// time budget of the analysis in milliseconds, 0 for none
+	unsigned deadline{0};
+	// this process scans the shard with 1-based index shard out of shards, if shards is not 0
+	unsigned shard{0};
+	unsigned shards{0};
+	std::filesystem::path shard_file;
+	std::vector<std::filesystem::path> merge_shards;
+	std::size_t limit{0};
 	std::string log_format;
 	std::vector<std::string> path;
 	std::vector<std::string> bl_path;
 	std::vector<std::string> domains;
-	std::vector<std::string> fixes_matchers{{R"(Fixes:\s([A-Fa-f0-9]+)\s\(".+"\))"}};
+	std::vector<std::string> fixes_matchers{{R"re(Fixes:\s([A-Fa-f0-9]+)\s\("(.+)"\))re"}};
 	std::vector<std::string> tagMatchers;
 	std::filesystem::path tagSet;
+	std::filesystem::path manifest;
+	std::string fixes_for;
+	unsigned jobs{0};
+	std::filesystem::path output_dir{"."};
+	// libgit2 memory limits, its defaults are kept when unset
+	std::optional<std::int64_t> cache_max_size;
+	std::optional<std::size_t> pack_window_size;
+	std::optional<std::size_t> pack_mapped_limit;
+	// memory budget in bytes, 0 for none
+	std::size_t max_memory{0};
+	std::filesystem::path trace_file;
 };
 
 void loadOptions(Options& options, git_repository& repo);
 
-std::vector<Commit> fixes(
+/**
+ * @brief Applies the libgit2 memory limits from the options, they are global for the process
+ */
+void applyLibgitOptions(const Options& options);
+
+/**
+ * @brief How far an analysis cut short by the deadline got
+ */
+struct ScanProgress {
+	std::size_t scanned;
+	std::size_t total;
+	// scanned commits left unjudged, the deadline came before it was known whether their references hit the target
+	std::size_t undecided;
+	// the newest source commit left unscanned, the scan went from the newest commit down to it; none if all were
+	std::optional<git_oid> stoppedAt;
+};
+
+/**
+ * @brief Produces the pending fixes lazily, in the order they are to be applied
+ *
+ * The target side state needed to judge the fixes is collected on construction, the source commits are analyzed
+ * only as far as needed to produce the next fix.
+ */
+class FixesScanner {
+public:
+	FixesScanner(const Options& opts, git_repository& repo, const std::vector<git_oid>& blacklist);
+	~FixesScanner();
+
+	FixesScanner(const FixesScanner&) = delete;
+	FixesScanner& operator=(const FixesScanner&) = delete;
+
+	std::optional<CommitWithReferences> next();
+
+	/**
+	 * @brief Progress of the analysis if the deadline cut it short, the fixes are then found among the analyzed
+	 * commits only
+	 */
+	std::optional<ScanProgress> partial() const;
+
+	/**
+	 * @brief Scans the source commits of the shard selected in the options and writes the records for --merge-shards
+	 */
+	void writeShard(const std::filesystem::path& path);
+
+	/**
+	 * @brief Stores the analysis results for the next run, if the incremental mode is on
+	 */
+	void saveState() const;
+
+private:
+	struct State;
+	std::unique_ptr<State> state_;
+};
+
+/**
+ * @brief Lists the pending fixes, at most opts.limit of them unless that is 0
+ *
+ * @param partial receives the progress if the deadline cut the analysis short
+ */
+std::vector<CommitWithReferences> fixes(
 	const Options& opts,
 	git_repository& repo,
-	const std::vector<git_oid>& blacklist);
+	const std::vector<git_oid>& blacklist,
+	std::optional<ScanProgress>* partial = nullptr);
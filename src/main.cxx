@@ -7,11 +7,18 @@
 #include <git2/global.h>
 #include <git2/repository.h>
 
+#include <format>
 #include <iostream>
-#include <map>
+#include <optional>
+#include <sstream>
 
+#include "apply-check.hxx"
+#include "fixes-index.hxx"
 #include "git-fixes.hxx"
 #include "git-list-fixes-config.hxx"
+#include "manifest.hxx"
+#include "output.hxx"
+#include "trace.hxx"
 
 struct CommitSHAValidator: CLI::Validator {
 	CommitSHAValidator()
@@ -34,15 +41,6 @@ struct libgit2 {
 	~libgit2() { git_libgit2_shutdown(); }
 };
 
-struct git_repo_deleter {
-	void operator()(git_repository* repo)
-	{
-		if (repo) {
-			git_repository_free(repo);
-		}
-	}
-};
-
 git_repository* repository_open(const std::filesystem::path& repo)
 {
 	git_repository* result;
@@ -50,25 +48,17 @@ git_repository* repository_open(const std::filesystem::path& repo)
 	return result;
 }
 
-int main(int argc, char** argv)
+static void setupCommandLine(CLI::App& app, Options& opts, std::vector<git_oid>& blacklistIds)
 {
-	Options opts;
-	libgit2 libgit;
-	std::unique_ptr<git_repository, git_repo_deleter> repo;
-	try {
-		repo.reset(repository_open(opts.repo_path));
-		loadOptions(opts, *repo);
-	} catch (LibgitError&) {
-	}
-
-	CLI::App app;
 	CLI::Option_group* output_options = app.add_option_group("output", "Output controls");
 
 	app.add_option("revspec", opts.revision);
 	app.add_option("path", opts.path);
 
 	app.add_option("--repo,-r", opts.repo_path, "Path to git repo")->capture_default_str()->check(CLI::ExistingPath);
-	app.add_option("--source", opts.source, "Source revspec")->capture_default_str();
+	app.add_option("--source", opts.sources, "Source revspec, can be repeated to combine several source branches")
+		->allow_extra_args(false)
+		->capture_default_str();
 	app.add_flag("--reverse", opts.reverse, "Sort fixes in reverse order");
 	app.add_flag("--stable,!--no-stable", opts.stable, "Show only commits with a stable-tag")->capture_default_str();
 	app.add_option(
@@ -87,7 +77,54 @@ int main(int argc, char** argv)
 	CLI::Option* output_format = output_options->add_option("--format", opts.log_format, "`git log` format")->capture_default_str();
 #endif
 	CLI::Option* output_script =
-		output_options->add_flag("--script", opts.output_script, "Print out a sequence of `git cherry-pick` commands")->capture_default_str();
+		output_options
+			->add_flag(
+				"--script", opts.output_script,
+				"Print out `git cherry-pick` commands, ordered so that each fix comes after the fixes it depends on")
+			->capture_default_str();
+	output_options
+		->add_option("--script-batch", opts.script_batch, "Number of commits per `git cherry-pick` command of the script")
+		->capture_default_str()
+		->needs(output_script);
+	output_options
+		->add_flag(
+			"--script-stdin", opts.script_stdin,
+			"Pass all the commits to a single `git cherry-pick --stdin` in the script, for very long lists")
+		->needs(output_script);
+	CLI::Option* output_check_apply = output_options->add_flag(
+		"--check-apply", opts.check_apply,
+		"Cherry-pick the fixes onto the target in memory and print whether each one applies cleanly, only after the "
+		"preceding fixes, or conflicts");
+	CLI::Option* output_exists = output_options->add_flag(
+		"--exists", opts.exists, "Print nothing, exit with status 0 if there are pending fixes and with 1 otherwise");
+	app.add_flag(
+		"--incremental", opts.incremental,
+		"Reuse the analysis results stored in the repository by the previous run with the same options and only "
+		"analyze the commits added since");
+	app.add_option(
+		   "--max-memory", opts.max_memory,
+		   "Memory budget, e.g. 512MB: only the commit ids and references are kept in memory, the commits visited "
+		   "to check reachability go to a temporary file beyond the budget")
+		->transform(CLI::AsSizeValue(false));
+	app.add_flag(
+		"--patch-id", opts.patch_ids,
+		"Also treat the commits with the same patch id as copies of each other, for the cherry-picks made without -x");
+	app.add_option(
+		"--identity-trailer", opts.identity_trailer,
+		"Also treat the commits with the same value of this trailer (e.g. Change-Id) as copies of each other");
+	app.add_option(
+		   "--jobs,-j", opts.jobs,
+		   "Number of worker threads, 0 means one per CPU core. With 1 the source commits are also scanned on the "
+		   "main thread instead of a reading and a matching one. With --manifest the number of repositories "
+		   "processed at a time")
+		->capture_default_str();
+	app.add_option("--limit,-n", opts.limit, "Stop after finding that many fixes, 0 means no limit")->capture_default_str();
+	app.add_option(
+		   "--deadline", opts.deadline,
+		   "Time budget in milliseconds, the newest source commits are analyzed first and when the time runs out the "
+		   "fixes found so far are printed, a 'partial' line is written to stderr and the exit status is 3. With "
+		   "--incremental the next run continues the analysis")
+		->capture_default_str();
 
 	app.add_option(
 		   "--ignore-file", opts.ignore_file,
@@ -103,11 +140,11 @@ int main(int argc, char** argv)
 	app.add_option("-b,--blacklist", opts.bl_file, "Read blacklist from file")->check(CLI::ExistingFile);
 	app.add_flag("--no-blacklist", opts.no_blacklist, "Also show blacklisted commits");
 	app.add_option_function(
-		   "--Blacklist,-B", std::function{[&opts](const std::string& value) {
+		   "--Blacklist,-B", std::function{[&opts, &blacklistIds](const std::string& value) {
 			   opts.write_bl = true;
 			   git_oid id;
 			   git_oid_fromstr(&id, value.c_str());
-			   blacklist.push_back(id);
+			   blacklistIds.push_back(id);
 		   }},
 		   "Add commit to blacklist")
 		->check(CommitSHAValidator());
@@ -135,65 +172,133 @@ int main(int argc, char** argv)
 	optAll->excludes(optCommitter)->excludes(optMe);
 
 	output_script->excludes(output_grouping, output_stats);
+	output_exists->excludes(output_script, output_grouping, output_stats);
+	output_check_apply->excludes(output_script, output_grouping, output_stats, output_exists);
 #ifdef Git_FOUND
 	output_script->excludes(output_format);
+	output_exists->excludes(output_format);
+	output_check_apply->excludes(output_format);
 #endif
+}
+
+int main(int argc, char** argv)
+{
+	Options opts;
+	libgit2 libgit;
+	std::unique_ptr<git_repository, git_repo_deleter> repo;
+	try {
+		repo.reset(repository_open(opts.repo_path));
+		loadOptions(opts, *repo);
+	} catch (LibgitError&) {
+	}
+
+	CLI::App app;
+	setupCommandLine(app, opts, blacklist);
+	app.add_option(
+		"--fixes-for", opts.fixes_for,
+		"List the fixes and reverts of the given commit or range using the index of the source history, which is "
+		"built or updated as needed, instead of comparing the branches");
+	app.add_option(
+		   "--manifest", opts.manifest,
+		   "Process the repositories and branches listed in the file instead, one entry per line: repository path "
+		   "followed by the command line for it")
+		->check(CLI::ExistingFile);
+	app.add_option("--output-dir", opts.output_dir, "Directory for the per entry outputs of the manifest mode")
+		->capture_default_str();
+	app.add_option(
+		   "--cache-max-size", opts.cache_max_size,
+		   "Memory limit of the libgit2 object cache, e.g. 256MB (config list-fixes.cacheMaxSize)")
+		->transform(CLI::AsSizeValue(false));
+	app.add_option(
+		   "--pack-window-size", opts.pack_window_size,
+		   "Size of a single mapped pack file window (config list-fixes.packWindowSize)")
+		->transform(CLI::AsSizeValue(false));
+	app.add_option(
+		   "--pack-mapped-limit", opts.pack_mapped_limit,
+		   "Memory limit of all the mapped pack file windows (config list-fixes.packMappedLimit)")
+		->transform(CLI::AsSizeValue(false));
+	app.add_option(
+		"--trace-file", opts.trace_file,
+		"Write a timeline of the run in the Chrome trace event format, for Perfetto or chrome://tracing");
+	CLI::Option* optShard = app.add_option_function(
+		"--shard", std::function{[&opts](const std::string& value) {
+			unsigned index{0};
+			unsigned count{0};
+			char separator{};
+			std::istringstream stream{value};
+			if (!(stream >> index >> separator >> count) || !stream.eof() || separator != '/' || index == 0 ||
+			    index > count) {
+				throw CLI::ValidationError("--shard", "expected <index>/<count> with 1 <= index <= count");
+			}
+			opts.shard = index;
+			opts.shards = count;
+		}},
+		"Scan only the given slice i/n of the source commits and write the results into --shard-file, for "
+		"--merge-shards to combine");
+	CLI::Option* optShardFile =
+		app.add_option("--shard-file", opts.shard_file, "Output file of --shard, shard-<i>-of-<n>.state by default");
+	CLI::Option* optMergeShards = app.add_option(
+									   "--merge-shards", opts.merge_shards,
+									   "Print the fixes from the shard files written by --shard runs, the same as a "
+									   "single run would have found")
+									  ->check(CLI::ExistingFile);
+	optShardFile->needs(optShard);
+	optShard->excludes(optMergeShards);
+	// a shard file has to hold the whole target side
+	optShard->excludes("--deadline");
 
 	CLI11_PARSE(app, argc, argv);
 	try {
+		applyLibgitOptions(opts);
+		TraceSession trace{opts.trace_file};
+
+		if (!opts.manifest.empty()) {
+			std::vector<ManifestResult> results{run_manifest(
+				load_manifest(opts.manifest), opts.jobs, opts.output_dir,
+				[](const std::string& arguments, Options& entryOpts, std::vector<git_oid>& entryBlacklist) {
+					CLI::App entryApp;
+					setupCommandLine(entryApp, entryOpts, entryBlacklist);
+					entryApp.parse(arguments, false);
+				})};
+			return print_manifest_summary(std::cout, results) ? 0 : 2;
+		}
+
 		if (!repo) {
 			repo.reset(repository_open(opts.repo_path));
 		}
-		std::vector<Commit> fixupCommits{fixes(opts, *repo, blacklist)};
-
-		auto printGroup = [&opts](const std::vector<Commit>& commits) {
-			for (const Commit& c: commits) {
-				std::cout << c.logFormat(opts.log_format);
-			}
-		};
-
-		auto printGroupWithIndent = [&opts](const std::vector<Commit>& commits, unsigned indent = 0) {
-			std::string indentedNewLine = "\n";
-			for (unsigned i = 0; i < indent; ++i) {
-				indentedNewLine += '\t';
-			}
-			for (const Commit& commit: commits) {
-				std::string cLog = commit.logFormat(opts.log_format);
-				if (cLog.empty()) {
-					continue;
-				}
-				for (unsigned i = 0; i < indent; ++i) {
-					std::cout << '\t';
-				}
-				for (std::size_t i = 0; i < cLog.size() - 1; ++i) {
-					char c = cLog[i];
-					if (c == '\n') {
-						std::cout << indentedNewLine;
-					} else {
-						std::cout << c;
-					}
-				}
-				std::cout << cLog.back();
+		if (!opts.fixes_for.empty()) {
+			std::vector<CommitWithReferences> found{fixes_for(*repo, opts)};
+			printFixes(std::cout, opts, found);
+			return 0;
+		}
+		if (opts.shards) {
+			FixesScanner scanner{opts, *repo, blacklist};
+			scanner.writeShard(
+				opts.shard_file.empty() ? std::filesystem::path{std::format("shard-{}-of-{}.state", opts.shard, opts.shards)}
+										: opts.shard_file);
+			return 0;
+		}
+		if (opts.exists) {
+			FixesScanner scanner{opts, *repo, blacklist};
+			bool found = scanner.next().has_value();
+			scanner.saveState();
+			if (std::optional<ScanProgress> partial = scanner.partial(); partial && !found) {
+				printPartial(std::cerr, *partial);
+				return 3;
 			}
-		};
+			return found ? 0 : 1;
+		}
 
-		if (opts.output_script) {
-			for (const Commit& commit: fixupCommits) {
-				std::cout << "git cherry-pick -x " << oid_to_string(commit.id()) << '\n';
-			}
+		std::optional<ScanProgress> partial;
+		std::vector<CommitWithReferences> fixupCommits{fixes(opts, *repo, blacklist, &partial)};
+		if (opts.check_apply) {
+			print_apply_check(std::cout, *repo, opts, fixupCommits);
 		} else {
-			if (opts.group) {
-				std::map<std::string, std::vector<Commit>> groups;
-				for (Commit& c: fixupCommits) {
-					groups[c.authorWithEmail()].push_back(std::move(c));
-				}
-				for (const auto& [group, commits]: groups) {
-					std::cout << group << ":\n";
-					printGroupWithIndent(commits, 1);
-				}
-			} else {
-				printGroup(fixupCommits);
-			}
+			printFixes(std::cout, opts, fixupCommits);
+		}
+		if (partial) {
+			printPartial(std::cerr, *partial);
+			return 3;
 		}
 	} catch (std::exception& ex) {
 		std::cerr << "Error: " << ex.what() << std::endl;
@@ -0,0 +1,189 @@
+#include "manifest.hxx"
+
+#include "apply-check.hxx"
+#include "git-fixes.hxx"
+#include "output.hxx"
+#include "trace.hxx"
+#include "utility.hxx"
+
+#include <git2/repository.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+	// file name for the output of an entry, unique within the manifest
+	std::string outputName(const ManifestEntry& entry)
+	{
+		std::string result = std::format("{:04}-{}", entry.line, entry.repo.filename().string());
+		auto unsafe = [](char c) { return !std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_' && c != '.'; };
+		std::ranges::replace_if(result, unsafe, '_');
+		return result + ".txt";
+	}
+
+	void processEntry(
+		git_repository& repo, const ManifestArgumentsParser& parseArguments, unsigned threads, ManifestResult& result)
+	{
+		TraceSpan span{"manifest entry"};
+		Options opts;
+		loadOptions(opts, repo);
+		std::vector<git_oid> blacklist;
+		parseArguments(result.entry->arguments, opts, blacklist);
+		opts.repo_path = result.entry->repo;
+		if (opts.jobs == 0) {
+			// all the cores are shared by the workers
+			opts.jobs = threads;
+		}
+
+		if (opts.exists) {
+			FixesScanner scanner{opts, repo, blacklist};
+			result.exists = true;
+			result.fixes = scanner.next() ? 1 : 0;
+			scanner.saveState();
+			result.partial = !result.fixes && scanner.partial();
+			return;
+		}
+
+		std::optional<ScanProgress> partial;
+		std::vector<CommitWithReferences> fixupCommits{fixes(opts, repo, blacklist, &partial)};
+		result.fixes = fixupCommits.size();
+		result.partial = partial.has_value();
+
+		std::ofstream out{result.output, std::ios::trunc};
+		if (!out) {
+			throw std::runtime_error(std::format("Could not write {}", result.output.string()));
+		}
+		if (opts.check_apply) {
+			print_apply_check(out, repo, opts, fixupCommits);
+		} else {
+			printFixes(out, opts, fixupCommits);
+		}
+	}
+} // namespace
+
+std::vector<ManifestEntry> load_manifest(const std::filesystem::path& filePath)
+{
+	std::ifstream file{filePath};
+	if (!file) {
+		throw std::runtime_error("could not read the manifest file");
+	}
+
+	/*
+	 * Format of the manifest file:
+	 *
+	 * <repository path> <command line>
+	 *
+	 * The command line is parsed as git-list-fixes arguments, e.g.:
+	 * /srv/git/project release/2.4 --source master --source upstream/master
+	 *
+	 * Lines starting with '#' are ignored
+	 */
+
+	std::vector<ManifestEntry> result;
+	std::string line;
+	std::size_t currentLineNumber{};
+	while (std::getline(file, line)) {
+		++currentLineNumber;
+		trimWhitespace(line);
+		if (line.starts_with('#') || line.empty()) {
+			continue;
+		}
+		std::string::size_type repoEnd = line.find_first_of(" \t");
+		ManifestEntry& entry = result.emplace_back();
+		// an absolute path replaces the directory
+		entry.repo = filePath.parent_path() / line.substr(0, repoEnd);
+		if (repoEnd != std::string::npos) {
+			entry.arguments = trimWhitespace(std::string_view{line}.substr(repoEnd));
+		}
+		entry.line = currentLineNumber;
+	}
+	return result;
+}
+
+std::vector<ManifestResult> run_manifest(
+	const std::vector<ManifestEntry>& entries, unsigned jobs, const std::filesystem::path& outputDir,
+	const ManifestArgumentsParser& parseArguments)
+{
+	std::filesystem::create_directories(outputDir);
+
+	std::vector<ManifestResult> results;
+	results.reserve(entries.size());
+	// entries sharing the repository, in the manifest order
+	std::map<std::filesystem::path, std::vector<std::size_t>> repositories;
+	for (const ManifestEntry& entry: entries) {
+		repositories[entry.repo.lexically_normal()].push_back(results.size());
+		results.push_back(ManifestResult{.entry = &entry, .output = outputDir / outputName(entry)});
+	}
+	std::vector<const std::vector<std::size_t>*> work;
+	for (const std::vector<std::size_t>& indices: repositories | std::views::values) {
+		work.push_back(&indices);
+	}
+
+	const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+	const unsigned workers = static_cast<unsigned>(std::min<std::size_t>(jobs ? jobs : cores, work.size()));
+	const unsigned threadsPerWorker = std::max(1u, cores / std::max(1u, workers));
+
+	std::atomic<std::size_t> nextWork{0};
+	auto worker = [&]() {
+		for (std::size_t i = nextWork++; i < work.size(); i = nextWork++) {
+			const std::vector<std::size_t>& indices = *work[i];
+			std::unique_ptr<git_repository, git_repo_deleter> repo;
+			git_repository* repoPtr;
+			if (int error = git_repository_open(&repoPtr, results[indices.front()].entry->repo.generic_string().c_str()); error < 0) {
+				std::string message{LibgitError(error).what()};
+				for (std::size_t index: indices) {
+					results[index].error = message;
+				}
+				continue;
+			}
+			repo.reset(repoPtr);
+
+			for (std::size_t index: indices) {
+				try {
+					processEntry(*repo, parseArguments, threadsPerWorker, results[index]);
+				} catch (std::exception& ex) {
+					results[index].error = ex.what();
+				}
+			}
+		}
+	};
+
+	{
+		std::vector<std::jthread> threads;
+		for (unsigned i = 0; i < workers; ++i) {
+			threads.emplace_back(worker);
+		}
+	}
+	return results;
+}
+
+bool print_manifest_summary(std::ostream& out, const std::vector<ManifestResult>& results)
+{
+	bool ok{true};
+	std::size_t total{0};
+	for (const ManifestResult& result: results) {
+		out << result.entry->repo.string() << ' ' << result.entry->arguments << ": ";
+		if (result.error.empty() && result.exists) {
+			out << (result.fixes ? "pending fixes" : result.partial ? "no pending fixes found (partial)" : "no pending fixes")
+				<< '\n';
+		} else if (result.error.empty()) {
+			out << result.fixes << (result.partial ? " fixes (partial) in " : " fixes in ") << result.output.string() << '\n';
+			total += result.fixes;
+		} else {
+			out << "error: " << result.error << '\n';
+			ok = false;
+		}
+	}
+	out << results.size() << " entries, " << total << " fixes\n";
+	return ok;
+}
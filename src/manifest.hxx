@@ -0,0 +1,57 @@
+#pragma once
+
+#include <git2/types.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct Options;
+
+struct ManifestEntry {
+	std::filesystem::path repo;
+	// command line for the entry, as it would be given to git-list-fixes
+	std::string arguments;
+	std::size_t line;
+};
+
+struct ManifestResult {
+	const ManifestEntry* entry;
+	std::filesystem::path output;
+	std::size_t fixes{0};
+	// the entry only asked whether there are pending fixes (--exists), fixes is 1 if there are
+	bool exists{false};
+	// the deadline cut the analysis short
+	bool partial{false};
+	std::string error{};
+};
+
+/**
+ * @brief Reads the manifest, the relative repository paths are resolved against the directory of the manifest
+ */
+std::vector<ManifestEntry> load_manifest(const std::filesystem::path& filePath);
+
+/**
+ * @brief Parses the command line of a manifest entry into the options, throws on errors
+ */
+using ManifestArgumentsParser =
+	std::function<void(const std::string& arguments, Options& opts, std::vector<git_oid>& blacklist)>;
+
+/**
+ * @brief Processes the manifest entries with at most jobs repositories at a time
+ *
+ * Each repository is opened once and its entries are processed one after another with the same handle. The fixes
+ * of each entry are written into a separate file in the output directory. An entry without its own --jobs gets
+ * an equal share of the cores for its threads.
+ */
+std::vector<ManifestResult> run_manifest(
+	const std::vector<ManifestEntry>& entries, unsigned jobs, const std::filesystem::path& outputDir,
+	const ManifestArgumentsParser& parseArguments);
+
+/**
+ * @brief Prints one line per entry, returns false if any of the entries failed
+ */
+bool print_manifest_summary(std::ostream& out, const std::vector<ManifestResult>& results);
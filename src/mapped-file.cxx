@@ -0,0 +1,125 @@
+#include "mapped-file.hxx"
+
+#include <format>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	ifndef WIN32_LEAN_AND_MEAN
+#		define WIN32_LEAN_AND_MEAN
+#	endif
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+namespace {
+	std::runtime_error mappingError(const std::filesystem::path& path)
+	{
+		return std::runtime_error(std::format("Could not map {}", path.string()));
+	}
+} // namespace
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+	HANDLE file = ::CreateFileW(
+		path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw mappingError(path);
+	}
+	LARGE_INTEGER size;
+	if (!::GetFileSizeEx(file, &size)) {
+		::CloseHandle(file);
+		throw mappingError(path);
+	}
+	size_ = static_cast<std::size_t>(size.QuadPart);
+	if (size_ > 0) {
+		mapping_ = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping_) {
+			data_ = static_cast<const std::byte*>(::MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+		}
+	}
+	::CloseHandle(file);
+	if (size_ > 0 && !data_) {
+		unmap();
+		throw mappingError(path);
+	}
+}
+
+void MappedFile::unmap()
+{
+	if (data_) {
+		::UnmapViewOfFile(data_);
+	}
+	if (mapping_) {
+		::CloseHandle(mapping_);
+	}
+	data_ = nullptr;
+	mapping_ = nullptr;
+	size_ = 0;
+}
+#else
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw mappingError(path);
+	}
+	struct stat st;
+	if (::fstat(fd, &st)) {
+		::close(fd);
+		throw mappingError(path);
+	}
+	size_ = static_cast<std::size_t>(st.st_size);
+	if (size_ > 0) {
+		void* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			::close(fd);
+			throw mappingError(path);
+		}
+		data_ = static_cast<const std::byte*>(data);
+	}
+	::close(fd);
+}
+
+void MappedFile::unmap()
+{
+	if (data_) {
+		::munmap(const_cast<std::byte*>(data_), size_);
+	}
+	data_ = nullptr;
+	size_ = 0;
+}
+#endif
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+	: data_{std::exchange(other.data_, nullptr)}
+	, size_{std::exchange(other.size_, 0)}
+#ifdef _WIN32
+	, mapping_{std::exchange(other.mapping_, nullptr)}
+#endif
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	unmap();
+	data_ = std::exchange(other.data_, nullptr);
+	size_ = std::exchange(other.size_, 0);
+#ifdef _WIN32
+	mapping_ = std::exchange(other.mapping_, nullptr);
+#endif
+	return *this;
+}
+
+MappedFile::~MappedFile()
+{
+	unmap();
+}
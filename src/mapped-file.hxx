@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+/**
+ * @brief Read-only memory mapping of a whole file
+ */
+class MappedFile {
+public:
+	/**
+	 * @brief Maps the file, throws std::runtime_error if it can not be opened
+	 */
+	explicit MappedFile(const std::filesystem::path& path);
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	std::span<const std::byte> data() const { return {data_, size_}; }
+
+private:
+	void unmap();
+
+	const std::byte* data_{};
+	std::size_t size_{};
+#ifdef _WIN32
+	void* mapping_{};
+#endif
+};
@@ -1,14 +1,12 @@
 #include "note.hxx"
 
-#include "commit.hxx"
-
 #include <git2/notes.h>
 
 #include <utility>
 
-Note::Note(const Commit& commit, git_repository& repo)
+Note::Note(const git_oid& commit, git_repository& repo)
 {
-	if (git_note_read(&note_, &repo, nullptr, &commit.id())) {
+	if (git_note_read(&note_, &repo, nullptr, &commit)) {
 		note_ = nullptr;
 	}
 }
@@ -4,11 +4,9 @@
 
 #include <string_view>
 
-class Commit;
-
 class Note {
 public:
-	Note(const Commit& commit, git_repository& repo);
+	Note(const git_oid& commit, git_repository& repo);
 	Note(Note&& other) noexcept;
 	~Note();
 
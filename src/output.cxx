@@ -0,0 +1,99 @@
+#include "output.hxx"
+
+#include "git-fixes.hxx"
+#include "trace.hxx"
+#include "utility.hxx"
+
+#include <algorithm>
+#include <format>
+#include <map>
+#include <string>
+
+namespace {
+	void printGroup(std::ostream& out, const Options& opts, const std::vector<CommitWithReferences>& commits)
+	{
+		for (const Commit& c: commits) {
+			out << c.logFormat(opts.log_format);
+		}
+	}
+
+	void printGroupWithIndent(std::ostream& out, const Options& opts, const std::vector<Commit>& commits, unsigned indent = 0)
+	{
+		std::string indentedNewLine = "\n";
+		for (unsigned i = 0; i < indent; ++i) {
+			indentedNewLine += '\t';
+		}
+		for (const Commit& commit: commits) {
+			std::string cLog = commit.logFormat(opts.log_format);
+			if (cLog.empty()) {
+				continue;
+			}
+			for (unsigned i = 0; i < indent; ++i) {
+				out << '\t';
+			}
+			for (std::size_t i = 0; i < cLog.size() - 1; ++i) {
+				char c = cLog[i];
+				if (c == '\n') {
+					out << indentedNewLine;
+				} else {
+					out << c;
+				}
+			}
+			out << cLog.back();
+		}
+	}
+
+	void printScript(std::ostream& out, const Options& opts, const std::vector<CommitWithReferences>& fixes)
+	{
+		const std::vector<std::size_t> order{dependencyOrder(fixes)};
+		if (opts.script_stdin) {
+			if (!order.empty()) {
+				out << "git cherry-pick -x --stdin <<'EOF'\n";
+				for (std::size_t index: order) {
+					out << oid_to_string(fixes[index].id()) << '\n';
+				}
+				out << "EOF\n";
+			}
+			return;
+		}
+
+		const std::size_t batch = std::max<std::size_t>(opts.script_batch, 1);
+		for (std::size_t i = 0; i < order.size(); ++i) {
+			out << (i % batch == 0 ? "git cherry-pick -x " : " ") << oid_to_string(fixes[order[i]].id());
+			if ((i + 1) % batch == 0 || i + 1 == order.size()) {
+				out << '\n';
+			}
+		}
+	}
+} // namespace
+
+void printPartial(std::ostream& out, const ScanProgress& progress)
+{
+	out << std::format(
+		"partial scanned={} total={} undecided={} stopped-at={}\n",
+		progress.scanned,
+		progress.total,
+		progress.undecided,
+		progress.stoppedAt ? oid_to_string(*progress.stoppedAt) : "-");
+}
+
+void printFixes(std::ostream& out, const Options& opts, std::vector<CommitWithReferences>& fixupCommits)
+{
+	TraceSpan span{"print fixes"};
+	if (opts.output_script) {
+		printScript(out, opts, fixupCommits);
+	} else {
+		if (opts.group) {
+			std::map<std::string, std::vector<Commit>> groups;
+			for (CommitWithReferences& c: fixupCommits) {
+				groups[c.authorWithEmail()].push_back(std::move(c));
+			}
+			for (const auto& [group, commits]: groups) {
+				out << group << ":\n";
+				printGroupWithIndent(out, opts, commits, 1);
+			}
+		} else {
+			printGroup(out, opts, fixupCommits);
+		}
+	}
+}
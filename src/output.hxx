@@ -0,0 +1,19 @@
+#pragma once
+
+#include "commit.hxx"
+#include "git-fixes.hxx"
+
+#include <ostream>
+#include <vector>
+
+/**
+ * @brief Prints the fixes in the format selected by the options
+ *
+ * The commits may be moved from when grouping them.
+ */
+void printFixes(std::ostream& out, const Options& opts, std::vector<CommitWithReferences>& fixupCommits);
+
+/**
+ * @brief Prints the single machine readable line telling the result is partial
+ */
+void printPartial(std::ostream& out, const ScanProgress& progress);
@@ -0,0 +1,282 @@
+#include "reachability.hxx"
+
+#include "commit.hxx"
+#include "trace.hxx"
+
+#include <git2/odb.h>
+#include <git2/repository.h>
+
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <optional>
+#include <random>
+#include <stdexcept>
+
+namespace {
+	// the clock is read every that many steps of the walk, an answer a few steps away is still given past the deadline
+	constexpr std::size_t deadlineCheckInterval{64};
+
+	/**
+	 * @brief Writes the merge of the two sorted lists into a new temporary file
+	 */
+	std::filesystem::path writeRun(std::span<const git_oid> left, std::span<const git_oid> right)
+	{
+		std::random_device random;
+		std::filesystem::path path{
+			std::filesystem::temp_directory_path() / std::format("list-fixes-reachable-{:08x}{:08x}", random(), random())};
+		std::ofstream out{path, std::ios::binary | std::ios::trunc};
+		auto write = [&out](const git_oid& id) { out.write(reinterpret_cast<const char*>(&id), sizeof(id)); };
+		auto l = left.begin();
+		auto r = right.begin();
+		while (l != left.end() || r != right.end()) {
+			if (r == right.end() || (l != left.end() && *l < *r)) {
+				write(*l++);
+			} else {
+				write(*r++);
+			}
+		}
+		if (!out.flush()) {
+			throw std::runtime_error(std::format("Could not write {}", path.string()));
+		}
+		return path;
+	}
+} // namespace
+
+ReachabilityIndex::ReachabilityIndex(git_repository& repo, const git_oid& tip, std::size_t maxResident)
+	: repo_{repo}
+	, graph_{CommitGraph::open(repo)}
+	, maxResident_{maxResident}
+{
+	LibgitError::check(git_repository_odb(&odb_, &repo));
+	if (graph_) {
+		discoveredInGraph_.resize(graph_->size());
+	}
+	if (std::optional<Node> start = node(tip)) {
+		discover(*start);
+		frontier_.push(*start);
+	}
+}
+
+ReachabilityIndex::~ReachabilityIndex()
+{
+	git_odb_free(odb_);
+	std::vector<std::filesystem::path> paths;
+	for (Run& run: runs_) {
+		paths.push_back(std::move(run.path));
+	}
+	// unmapped first, the files can not be removed while mapped on Windows
+	runs_.clear();
+	for (const std::filesystem::path& path: paths) {
+		std::error_code ignored;
+		std::filesystem::remove(path, ignored);
+	}
+}
+
+bool ReachabilityIndex::reachable(const git_oid& id)
+{
+	std::optional<Node> query = node(id);
+	if (!query) {
+		return false;
+	}
+	return discovered(*query) || *walkDownTo(query->generation, &*query);
+}
+
+std::optional<bool> ReachabilityIndex::reachable(const git_oid& id, std::chrono::steady_clock::time_point deadline)
+{
+	std::optional<Node> query = node(id);
+	if (!query) {
+		return false;
+	}
+	if (discovered(*query)) {
+		return true;
+	}
+	return walkDownTo(query->generation, &*query, deadline);
+}
+
+std::vector<bool> ReachabilityIndex::reachable(const std::vector<git_oid>& ids)
+{
+	std::vector<std::optional<Node>> queries;
+	queries.reserve(ids.size());
+	std::optional<std::uint32_t> lowest;
+	for (const git_oid& id: ids) {
+		std::optional<Node>& query = queries.emplace_back(node(id));
+		if (query && !discovered(*query)) {
+			lowest = std::min(lowest.value_or(query->generation), query->generation);
+		}
+	}
+	if (lowest) {
+		walkDownTo(*lowest, nullptr);
+	}
+
+	// the commits missing in the graph are merge-joined with the spilled ones
+	std::vector<std::size_t> order;
+	std::vector<bool> result(ids.size());
+	for (std::size_t index = 0; index < ids.size(); ++index) {
+		if (!queries[index]) {
+			continue;
+		}
+		if (queries[index]->position != outsideGraph) {
+			result[index] = discoveredInGraph_[queries[index]->position];
+		} else {
+			order.push_back(index);
+		}
+	}
+	std::ranges::sort(order, std::less<>{}, [&ids](std::size_t index) { return ids[index]; });
+
+	for (std::size_t index: order) {
+		result[index] = visited_.contains(ids[index]);
+	}
+	for (const Run& run: runs_) {
+		std::span<const git_oid> sorted{run.ids()};
+		auto position = sorted.begin();
+		for (std::size_t index: order) {
+			// the ids only grow, so the search continues from the previous match
+			position = std::lower_bound(position, sorted.end(), ids[index], std::less<>{});
+			result[index] = result[index] || (position != sorted.end() && *position == ids[index]);
+		}
+	}
+	return result;
+}
+
+std::optional<ReachabilityIndex::Node> ReachabilityIndex::node(const git_oid& id) const
+{
+	if (graph_) {
+		if (std::optional<CommitGraph::Position> position = graph_->find(id)) {
+			return graphNode(*position);
+		}
+	}
+	std::size_t size;
+	git_object_t type;
+	if (git_odb_read_header(&size, &type, odb_, &id) || type != GIT_OBJECT_COMMIT) {
+		return std::nullopt;
+	}
+	return Node{.generation = CommitGraph::infiniteGeneration, .position = outsideGraph, .id = id};
+}
+
+ReachabilityIndex::Node ReachabilityIndex::graphNode(CommitGraph::Position position) const
+{
+	return Node{.generation = graph_->generation(position), .position = position, .id = graph_->id(position)};
+}
+
+bool ReachabilityIndex::discovered(const Node& node) const
+{
+	if (node.position != outsideGraph) {
+		return discoveredInGraph_[node.position];
+	}
+	return visited_.contains(node.id) || spilled(node.id);
+}
+
+bool ReachabilityIndex::discover(const Node& node)
+{
+	if (discovered(node)) {
+		return false;
+	}
+	if (node.position != outsideGraph) {
+		discoveredInGraph_[node.position] = true;
+	} else {
+		insert(node.id);
+	}
+	return true;
+}
+
+std::optional<bool> ReachabilityIndex::walkDownTo(
+	std::uint32_t generation, const Node* stopAt, std::optional<std::chrono::steady_clock::time_point> deadline)
+{
+	std::vector<Node> next;
+	for (std::size_t walked = 0; !frontier_.empty() && frontier_.top().generation >= generation; ++walked) {
+		if (deadline && walked % deadlineCheckInterval == deadlineCheckInterval - 1 &&
+		    std::chrono::steady_clock::now() >= *deadline) {
+			return std::nullopt;
+		}
+		const Node current{frontier_.top()};
+		frontier_.pop();
+		next.clear();
+		parents(current, next);
+		for (const Node& parent: next) {
+			if (!discover(parent)) {
+				continue;
+			}
+			frontier_.push(parent);
+			if (stopAt && parent.sameCommit(*stopAt)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void ReachabilityIndex::parents(const Node& node, std::vector<Node>& result)
+{
+	if (node.position != outsideGraph) {
+		positions_.clear();
+		graph_->parents(node.position, positions_);
+		for (CommitGraph::Position position: positions_) {
+			result.push_back(graphNode(position));
+		}
+		return;
+	}
+
+	// the parents of the boundary commits of a shallow or partial clone are missing
+	if (!git_odb_exists(odb_, &node.id)) {
+		return;
+	}
+	for (const git_oid& parent: RawCommit{repo_, node.id, RawCommit::Notes::Skip}.parents()) {
+		std::optional<CommitGraph::Position> position = graph_ ? graph_->find(parent) : std::nullopt;
+		result.push_back(
+			position ? graphNode(*position)
+					 : Node{.generation = CommitGraph::infiniteGeneration, .position = outsideGraph, .id = parent});
+	}
+}
+
+void ReachabilityIndex::insert(const git_oid& id)
+{
+	visited_.insert(id);
+	if (visited_.size() > maxResident_) {
+		spill();
+	}
+}
+
+bool ReachabilityIndex::spilled(const git_oid& id) const
+{
+	return std::ranges::any_of(runs_, [&id](const Run& run) { return std::ranges::binary_search(run.ids(), id, std::less<>{}); });
+}
+
+/**
+ * @brief Writes the visited commits held in memory into a sorted file, merging the files of similar sizes
+ */
+void ReachabilityIndex::spill()
+{
+	TraceSpan span{"spill reachability"};
+	std::vector<git_oid> resident{visited_.begin(), visited_.end()};
+	std::ranges::sort(resident, std::less<>{});
+	visited_.clear();
+
+	std::filesystem::path path{writeRun(resident, {})};
+	resident = {};
+	runs_.push_back(Run{.file = MappedFile{path}, .path = path});
+	while (runs_.size() > 1 && runs_[runs_.size() - 2].ids().size() <= 2 * runs_.back().ids().size()) {
+		std::filesystem::path merged;
+		std::vector<std::filesystem::path> obsolete;
+		{
+			// both are unmapped at the end of the scope, before their files are removed
+			Run newer{std::move(runs_.back())};
+			runs_.pop_back();
+			Run older{std::move(runs_.back())};
+			runs_.pop_back();
+			merged = writeRun(older.ids(), newer.ids());
+			obsolete = {std::move(older.path), std::move(newer.path)};
+		}
+		for (const std::filesystem::path& file: obsolete) {
+			std::filesystem::remove(file);
+		}
+		runs_.push_back(Run{.file = MappedFile{merged}, .path = merged});
+	}
+}
+
+std::span<const git_oid> ReachabilityIndex::Run::ids() const
+{
+	std::span<const std::byte> data{file.data()};
+	return {reinterpret_cast<const git_oid*>(data.data()), data.size() / sizeof(git_oid)};
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "commit-graph.hxx"
+#include "mapped-file.hxx"
+#include "utility.hxx"
+
+#include <git2/types.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <span>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief Answers whether a commit is an ancestor of (reachable from) the given tip
+ *
+ * The history of the tip is walked lazily in the order of the generation numbers of the commit-graph and every
+ * discovered commit is remembered, so each commit is visited at most once no matter how many queries are made.
+ * No ancestor of a commit has a higher generation, so a query stops the walk as soon as the frontier went below
+ * the generation of the queried commit. The commits missing in the graph (all of them, when the repository has
+ * none) rank above every commit in it, a query for one of them walks all the commits missing in the graph.
+ *
+ * The discovered commits of the graph are kept in a bitmap by their position. When more than maxResident other
+ * discovered commits are held in memory, they are written into a sorted file which is mapped and searched instead.
+ * Like the levels of a log-structured merge tree, a file is merged with the previous one only while that one is
+ * not more than twice as large, so every spilled commit is rewritten a logarithmic number of times.
+ */
+class ReachabilityIndex {
+public:
+	ReachabilityIndex(
+		git_repository& repo, const git_oid& tip, std::size_t maxResident = std::numeric_limits<std::size_t>::max());
+	~ReachabilityIndex();
+
+	ReachabilityIndex(const ReachabilityIndex&) = delete;
+	ReachabilityIndex& operator=(const ReachabilityIndex&) = delete;
+
+	bool reachable(const git_oid& id);
+
+	/**
+	 * @brief Like reachable(), but nullopt if the deadline came before the answer
+	 *
+	 * The walk stops where it got to and the next query continues from there.
+	 */
+	std::optional<bool> reachable(const git_oid& id, std::chrono::steady_clock::time_point deadline);
+
+	/**
+	 * @brief Answers the queries in one go, the result is in the order of the ids
+	 *
+	 * The walk goes as deep as the lowest generation of the queried commits needs, then the sorted ids are
+	 * merge-joined with each file of the spilled commits.
+	 */
+	std::vector<bool> reachable(const std::vector<git_oid>& ids);
+
+private:
+	static constexpr CommitGraph::Position outsideGraph{std::numeric_limits<CommitGraph::Position>::max()};
+
+	struct Node {
+		std::uint32_t generation;
+		CommitGraph::Position position;
+		git_oid id;
+
+		bool sameCommit(const Node& other) const
+		{
+			return position == other.position && (position != outsideGraph || id == other.id);
+		}
+		// the frontier is a max-heap by generation
+		bool operator<(const Node& other) const { return generation < other.generation; }
+	};
+
+	struct Run {
+		MappedFile file;
+		std::filesystem::path path;
+
+		std::span<const git_oid> ids() const;
+	};
+
+	// nullopt if there is no such commit
+	std::optional<Node> node(const git_oid& id) const;
+	Node graphNode(CommitGraph::Position position) const;
+	bool discovered(const Node& node) const;
+	// marks the commit as discovered, false if it already was
+	bool discover(const Node& node);
+	// walks until the frontier is below the generation, stops early once the commit is discovered, nullopt if the
+	// deadline came first
+	std::optional<bool> walkDownTo(
+		std::uint32_t generation,
+		const Node* stopAt,
+		std::optional<std::chrono::steady_clock::time_point> deadline = std::nullopt);
+	void parents(const Node& node, std::vector<Node>& result);
+	void insert(const git_oid& id);
+	bool spilled(const git_oid& id) const;
+	void spill();
+
+	git_repository& repo_;
+	git_odb* odb_;
+	std::optional<CommitGraph> graph_;
+	std::priority_queue<Node> frontier_;
+	// discovered commits of the graph by position
+	std::vector<bool> discoveredInGraph_;
+	// discovered commits missing in the graph
+	std::unordered_set<git_oid, OidHash> visited_;
+	std::vector<CommitGraph::Position> positions_;
+	std::size_t maxResident_;
+	// sorted files of the spilled commits, from the largest
+	std::vector<Run> runs_;
+};
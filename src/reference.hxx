@@ -3,7 +3,7 @@
 #include <git2/types.h>
 
 struct Reference {
-	enum class Kind { Fixes, Revert };
+	enum class Kind { Fixes, Revert, CherryPick };
 
 	git_oid id;
 	Kind kind;
@@ -0,0 +1,139 @@
+#include "scan-pipeline.hxx"
+
+#include "equivalence.hxx"
+#include "git-fixes.hxx"
+#include "tag-set.hxx"
+#include "trace.hxx"
+#include "utility.hxx"
+
+#include <git2/repository.h>
+
+#include <format>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+namespace {
+	// enough to keep both stages busy, small enough not to waste work when the judgement stops early
+	constexpr std::size_t queueCapacity{256};
+
+	std::map<std::string, std::vector<std::string>> loadTagSet(const Options& opts)
+	{
+		return opts.tagSet.empty() ? std::map<std::string, std::vector<std::string>>{} : load_tag_set(opts.tagSet);
+	}
+
+	git_repository* openRepository(git_repository& repo)
+	{
+		git_repository* result;
+		LibgitError::check(git_repository_open(&result, git_repository_path(&repo)));
+		return result;
+	}
+} // namespace
+
+SourceScanner::SourceScanner(const Options& opts, git_repository& repo, std::shared_ptr<SubjectIndex> subjects)
+	: repo_{repo}
+	, identityTrailer_{opts.identity_trailer}
+	, tokenizer_{opts.fixes_matchers, repo, std::move(subjects)}
+	, tagsMatcher_{opts.tagSet.empty() ? std::vector<std::string>{} : opts.tagMatchers, loadTagSet(opts)}
+	, otherFilters_{filterForSources(opts, repo)}
+{
+}
+
+void SourceScanner::operator()(SourceRecord& record) const
+{
+	(*this)(record, RawCommit{repo_, record.id});
+}
+
+void SourceScanner::operator()(SourceRecord& record, const RawCommit& commit) const
+{
+	TraceSpan span{"scan source commit"};
+	// std::clog << "Analyzing " << c.logFormat() << std::endl;
+	record.tagged = tagsMatcher_(commit);
+	for (const Reference& ref: tokenizer_(commit)) {
+		if (ref.kind == Reference::Kind::CherryPick) {
+			record.origins.push_back(ref.id);
+		} else {
+			record.references.push_back(ref);
+		}
+	}
+	record.accepted = !record.references.empty() && otherFilters_(commit);
+	if (!identityTrailer_.empty()) {
+		record.identity = identity_trailer(commit.message(), identityTrailer_).value_or(std::string{});
+	}
+	record.scanned = true;
+}
+
+ScanPipeline::ScanPipeline(
+	const Options& opts, git_repository& repo, std::vector<git_oid> ids, std::shared_ptr<SubjectIndex> subjects)
+	: loaderRepo_{openRepository(repo)}
+	, matcherRepo_{openRepository(repo)}
+	, commits_{queueCapacity}
+	, records_{queueCapacity}
+{
+	// set up before the threads start, so that the configuration errors surface here
+	auto scanner = std::make_shared<SourceScanner>(opts, *matcherRepo_, std::move(subjects));
+
+	loader_ = std::jthread{[this, ids = std::move(ids)] {
+		try {
+			for (const git_oid& id: ids) {
+				if (!commits_.push(RawCommit{*loaderRepo_, id})) {
+					break;
+				}
+			}
+		} catch (...) {
+			fail(std::current_exception());
+		}
+		commits_.close();
+	}};
+
+	matcher_ = std::jthread{[this, scanner] {
+		try {
+			while (std::optional<RawCommit> commit = commits_.pop()) {
+				SourceRecord record{.id = commit->id()};
+				(*scanner)(record, *commit);
+				if (!records_.push(std::move(record))) {
+					break;
+				}
+			}
+		} catch (...) {
+			fail(std::current_exception());
+		}
+		// stops the loader when the consumer went away
+		commits_.close();
+		records_.close();
+	}};
+}
+
+ScanPipeline::~ScanPipeline()
+{
+	records_.close();
+	commits_.close();
+	matcher_ = {};
+	loader_ = {};
+}
+
+SourceRecord ScanPipeline::next(const git_oid& id)
+{
+	if (std::optional<SourceRecord> record = records_.pop()) {
+		if (record->id != id) {
+			throw std::logic_error(
+				std::format("The scan pipeline produced {} instead of {}", oid_to_string(record->id), oid_to_string(id)));
+		}
+		return std::move(*record);
+	}
+	std::lock_guard lock{errorMutex_};
+	if (error_) {
+		std::rethrow_exception(error_);
+	}
+	throw std::logic_error("The scan pipeline ran out of commits");
+}
+
+void ScanPipeline::fail(std::exception_ptr error)
+{
+	std::lock_guard lock{errorMutex_};
+	if (!error_) {
+		error_ = error;
+	}
+	commits_.close();
+	records_.close();
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "filters.hxx"
+#include "scan-state.hxx"
+#include "spsc-queue.hxx"
+#include "utility.hxx"
+
+#include <git2/types.h>
+
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Options;
+class SubjectIndex;
+
+/**
+ * @brief Extracts the references of a source commit and applies the source filters to it
+ */
+class SourceScanner {
+public:
+	SourceScanner(const Options& opts, git_repository& repo, std::shared_ptr<SubjectIndex> subjects = {});
+
+	void operator()(SourceRecord& record) const;
+	void operator()(SourceRecord& record, const RawCommit& commit) const;
+
+private:
+	git_repository& repo_;
+	std::string identityTrailer_;
+	ReferenceTokenizer tokenizer_;
+	TagMatcher tagsMatcher_;
+	CompoundFilter otherFilters_;
+};
+
+/**
+ * @brief Scans the source commits ahead of the judgement on worker threads
+ *
+ * The loader stage reads the commits from the object database and the matcher stage scans them, each with its own
+ * repository handle. The stages are connected by bounded queues, so the reading and the matching overlap while
+ * the results come out in the order of the ids. The ids are those of the ranges walked beforehand, there is no
+ * walker stage.
+ */
+class ScanPipeline {
+public:
+	ScanPipeline(
+		const Options& opts, git_repository& repo, std::vector<git_oid> ids, std::shared_ptr<SubjectIndex> subjects = {});
+	~ScanPipeline();
+
+	ScanPipeline(const ScanPipeline&) = delete;
+	ScanPipeline& operator=(const ScanPipeline&) = delete;
+
+	/**
+	 * @brief The scanned record for the next id, which must be the given one, rethrows the errors of the stages
+	 */
+	SourceRecord next(const git_oid& id);
+
+private:
+	using RepositoryPtr = std::unique_ptr<git_repository, git_repo_deleter>;
+
+	void fail(std::exception_ptr error);
+
+	// the commits in the queues refer to the repositories, the threads go first
+	RepositoryPtr loaderRepo_;
+	RepositoryPtr matcherRepo_;
+	SpscQueue<RawCommit> commits_;
+	SpscQueue<SourceRecord> records_;
+	std::mutex errorMutex_;
+	std::exception_ptr error_;
+	std::jthread loader_;
+	std::jthread matcher_;
+};
@@ -0,0 +1,291 @@
+#include "scan-state.hxx"
+
+#include "config.hxx"
+#include "git-fixes.hxx"
+
+#include <git2/oid.h>
+#include <git2/repository.h>
+
+#include <charconv>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+
+namespace {
+	constexpr std::string_view header{"list-fixes-state 3"};
+
+	/*
+	 * Format of the state file:
+	 *
+	 * list-fixes-state 3
+	 * target <oid>
+	 * source <oid>                        one per source tip
+	 * base <oid>                          one per merge base of the target with a source
+	 * common <oid>                        one per merge base common to the target and all the sources
+	 * t <oid> [R:<oid>]... [P:<oid>]... [D:<oid>] [I:<value>]
+	 *                                     target commits with their reverts, cherry-pick origins, patch id and
+	 *                                     identity
+	 * s <oid> <flags> [F:<oid>|R:<oid>|P:<oid>]... [I:<value>]
+	 *                                     source commits from the oldest one, flags are '-' for not yet
+	 *                                     analyzed ones or any of 's' (scanned), 't' (tagged), 'a' (accepted)
+	 * y <oid> / n <oid>                   referenced commits (not) reachable from the target
+	 *
+	 * The identity trailer values have the whitespace, the control characters and '%' percent-encoded.
+	 */
+
+	bool parseOid(git_oid& oid, std::string_view text)
+	{
+		return text.size() == 40 && ishex(text) && !git_oid_fromstrn(&oid, text.data(), text.size());
+	}
+
+	bool parseOid(git_oid& oid, std::istream& stream)
+	{
+		std::string text;
+		return (stream >> text) && parseOid(oid, text);
+	}
+
+	std::string encodeValue(std::string_view value)
+	{
+		std::string result;
+		for (char c: value) {
+			const auto byte = static_cast<unsigned char>(c);
+			if (byte <= ' ' || byte == '%' || byte == 0x7f) {
+				result += std::format("%{:02X}", byte);
+			} else {
+				result += c;
+			}
+		}
+		return result;
+	}
+
+	bool decodeValue(std::string& result, std::string_view text)
+	{
+		result.clear();
+		for (std::size_t i = 0; i < text.size(); ++i) {
+			if (text[i] != '%') {
+				result += text[i];
+				continue;
+			}
+			unsigned char byte;
+			if (i + 2 >= text.size()) {
+				return false;
+			}
+			auto [end, error] = std::from_chars(text.data() + i + 1, text.data() + i + 3, byte, 16);
+			if (error != std::errc{} || end != text.data() + i + 3) {
+				return false;
+			}
+			result += static_cast<char>(byte);
+			i += 2;
+		}
+		return true;
+	}
+
+	// parses the "X:<oid>" items and the "I:<value>" one up to the end of the line
+	template <typename Add>
+	bool parseReferences(std::istream& stream, std::string& identity, Add add)
+	{
+		std::string item;
+		while (stream >> item) {
+			if (item.size() < 3 || item[1] != ':') {
+				return false;
+			}
+			const std::string_view value{std::string_view{item}.substr(2)};
+			if (item[0] == 'I') {
+				if (!decodeValue(identity, value)) {
+					return false;
+				}
+				continue;
+			}
+			git_oid oid;
+			if (!parseOid(oid, value) || !add(item[0], oid)) {
+				return false;
+			}
+		}
+		return true;
+	}
+} // namespace
+
+std::optional<ScanState> ScanState::load(const std::filesystem::path& path)
+{
+	std::ifstream file{path};
+	std::string line;
+	if (!file || !std::getline(file, line) || line != header) {
+		return std::nullopt;
+	}
+
+	ScanState result;
+	bool hasTarget{false};
+	while (std::getline(file, line)) {
+		std::istringstream stream{line};
+		std::string key;
+		stream >> key;
+		bool ok{true};
+		if (key == "target") {
+			ok = hasTarget = parseOid(result.target, stream);
+		} else if (key == "source") {
+			ok = parseOid(result.sources.emplace_back(), stream);
+		} else if (key == "base") {
+			ok = parseOid(result.mergeBases.emplace_back(), stream);
+		} else if (key == "common") {
+			ok = parseOid(result.commonBases.emplace_back(), stream);
+		} else if (key == "t") {
+			TargetRecord& record = result.targetCommits.emplace_back();
+			ok = parseOid(record.id, stream) && parseReferences(stream, record.identity, [&record](char kind, const git_oid& oid) {
+				switch (kind) {
+					case 'R': record.reverts.push_back(oid); return true;
+					case 'P': record.origins.push_back(oid); return true;
+					case 'D': record.patchId = oid; return true;
+					default: return false;
+				}
+			});
+		} else if (key == "s") {
+			SourceRecord& record = result.sourceCommits.emplace_back();
+			std::string flags;
+			ok = parseOid(record.id, stream) && (stream >> flags);
+			if (ok && flags != "-") {
+				record.scanned = flags.contains('s');
+				record.tagged = flags.contains('t');
+				record.accepted = flags.contains('a');
+			}
+			ok = ok && parseReferences(stream, record.identity, [&record](char kind, const git_oid& oid) {
+				switch (kind) {
+					case 'F': record.references.push_back({.id = oid, .kind = Reference::Kind::Fixes}); return true;
+					case 'R': record.references.push_back({.id = oid, .kind = Reference::Kind::Revert}); return true;
+					case 'P': record.origins.push_back(oid); return true;
+					default: return false;
+				}
+			});
+		} else if (key == "y" || key == "n") {
+			git_oid oid;
+			ok = parseOid(oid, stream);
+			result.reachable.emplace(oid, key == "y");
+		} else {
+			ok = false;
+		}
+		if (!ok) {
+			return std::nullopt;
+		}
+	}
+
+	if (!hasTarget || result.mergeBases.empty() || result.commonBases.empty() || result.sources.empty()) {
+		return std::nullopt;
+	}
+	return result;
+}
+
+void ScanState::save(const std::filesystem::path& path) const
+{
+	std::filesystem::create_directories(path.parent_path());
+	std::filesystem::path temporaryPath{path};
+	temporaryPath += ".tmp";
+	{
+		std::ofstream file{temporaryPath, std::ios::trunc};
+		if (!file) {
+			throw std::runtime_error(std::format("Could not write {}", temporaryPath.string()));
+		}
+
+		file << header << '\n';
+		file << "target " << oid_to_string(target) << '\n';
+		for (const git_oid& source: sources) {
+			file << "source " << oid_to_string(source) << '\n';
+		}
+		for (const git_oid& base: mergeBases) {
+			file << "base " << oid_to_string(base) << '\n';
+		}
+		for (const git_oid& base: commonBases) {
+			file << "common " << oid_to_string(base) << '\n';
+		}
+
+		for (const TargetRecord& record: targetCommits) {
+			file << "t " << oid_to_string(record.id);
+			for (const git_oid& oid: record.reverts) {
+				file << " R:" << oid_to_string(oid);
+			}
+			for (const git_oid& oid: record.origins) {
+				file << " P:" << oid_to_string(oid);
+			}
+			if (record.patchId) {
+				file << " D:" << oid_to_string(*record.patchId);
+			}
+			if (!record.identity.empty()) {
+				file << " I:" << encodeValue(record.identity);
+			}
+			file << '\n';
+		}
+
+		for (const SourceRecord& record: sourceCommits) {
+			file << "s " << oid_to_string(record.id) << ' ';
+			if (!record.scanned) {
+				file << '-';
+			} else {
+				file << 's';
+				if (record.tagged) {
+					file << 't';
+				}
+				if (record.accepted) {
+					file << 'a';
+				}
+			}
+			for (const Reference& ref: record.references) {
+				file << (ref.kind == Reference::Kind::Fixes ? " F:" : " R:") << oid_to_string(ref.id);
+			}
+			for (const git_oid& oid: record.origins) {
+				file << " P:" << oid_to_string(oid);
+			}
+			if (!record.identity.empty()) {
+				file << " I:" << encodeValue(record.identity);
+			}
+			file << '\n';
+		}
+
+		for (const auto& [oid, isReachable]: reachable) {
+			file << (isReachable ? "y " : "n ") << oid_to_string(oid) << '\n';
+		}
+
+		if (!file.flush()) {
+			throw std::runtime_error(std::format("Could not write {}", temporaryPath.string()));
+		}
+	}
+	std::filesystem::rename(temporaryPath, path);
+}
+
+std::filesystem::path scanStatePath(git_repository& repo, const Options& opts)
+{
+	// the state is only valid for the options which affect what is recorded in it
+	std::uint64_t hash{fnv1aOffsetBasis};
+	hash = fnv1a(hash, opts.revision);
+	for (const std::string& source: opts.sources) {
+		hash = fnv1a(hash, source);
+	}
+	for (const std::string& matcher: opts.fixes_matchers) {
+		hash = fnv1a(hash, matcher);
+	}
+	if (!opts.tagSet.empty()) {
+		std::ifstream tagSetFile{opts.tagSet};
+		std::ostringstream tagSet;
+		tagSet << tagSetFile.rdbuf();
+		hash = fnv1a(hash, tagSet.view());
+	}
+	for (const std::string& matcher: opts.tagMatchers) {
+		hash = fnv1a(hash, matcher);
+	}
+	hash = fnv1a(hash, opts.author);
+	// the accepted flags depend on the email --my resolves to
+	hash = fnv1a(hash, opts.my ? Config{repo}.readString("user.email").value_or("") : "");
+	if (!opts.identity_trailer.empty()) {
+		hash = fnv1a(hash, opts.identity_trailer);
+	}
+	// the target records hold the patch ids
+	if (opts.patch_ids) {
+		hash = fnv1a(hash, "patch-id");
+	}
+	// the target commits without references are left out within a memory budget, while a state with all of them
+	// would not fit into it
+	if (opts.max_memory) {
+		hash = fnv1a(hash, "bounded");
+	}
+
+	return std::filesystem::path{git_repository_path(&repo)} / "list-fixes" / std::format("state-{:016x}", hash);
+}
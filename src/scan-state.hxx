@@ -0,0 +1,73 @@
+#pragma once
+
+#include "reference.hxx"
+#include "utility.hxx"
+
+#include <git2/types.h>
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct Options;
+
+/**
+ * @brief What the analysis of a source commit found out
+ */
+struct SourceRecord {
+	git_oid id;
+	bool scanned{false};
+	bool tagged{false};
+	// whether the commit passes the other source filters (author and such)
+	bool accepted{false};
+	std::vector<Reference> references{};
+	// commits this one was cherry-picked from
+	std::vector<git_oid> origins{};
+	// value of the identity trailer, empty if none is configured or the commit has none
+	std::string identity{};
+};
+
+/**
+ * @brief Revert and cherry-pick references, the identity and the patch id of a target commit
+ */
+struct TargetRecord {
+	git_oid id;
+	std::vector<git_oid> reverts;
+	std::vector<git_oid> origins;
+	std::string identity{};
+	// only computed with --patch-id, none for the merges and the empty commits
+	std::optional<git_oid> patchId{};
+};
+
+/**
+ * @brief Analysis results that can be carried over to the next run
+ *
+ * Everything here depends only on the commits themselves and on the options that are part of the state key, the
+ * blacklist and such are applied again on each run.
+ */
+struct ScanState {
+	git_oid target;
+	std::vector<git_oid> sources;
+	// merge bases of the target with each source, sorted
+	std::vector<git_oid> mergeBases;
+	// merge bases common to the target and all the sources, the target range goes down to these, sorted
+	std::vector<git_oid> commonBases;
+	std::vector<TargetRecord> targetCommits;
+	// from the oldest commit
+	std::vector<SourceRecord> sourceCommits;
+	// whether a referenced commit is reachable from the target
+	std::unordered_map<git_oid, bool, OidHash> reachable;
+
+	/**
+	 * @brief Reads the state, returns nothing if it does not exist or can not be parsed
+	 */
+	static std::optional<ScanState> load(const std::filesystem::path& path);
+	void save(const std::filesystem::path& path) const;
+};
+
+/**
+ * @brief Location of the state file for the given options in the repository
+ */
+std::filesystem::path scanStatePath(git_repository& repo, const Options& opts);
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Bounded lock-free queue between one producer and one consumer thread
+ *
+ * A full or empty queue blocks the respective side on the atomic counter. Closing the queue, from either side,
+ * wakes both: the producer can not push any more and the consumer gets the remaining values first.
+ */
+template <typename T>
+class SpscQueue {
+public:
+	explicit SpscQueue(std::size_t capacity)
+		: slots_(std::bit_ceil(capacity))
+	{
+	}
+
+	SpscQueue(const SpscQueue&) = delete;
+	SpscQueue& operator=(const SpscQueue&) = delete;
+
+	/**
+	 * @brief Blocks while the queue is full, returns false if the queue is closed
+	 */
+	bool push(T value)
+	{
+		const std::size_t tail = tail_.load(std::memory_order_relaxed) & ~closedBit;
+		for (;;) {
+			const std::size_t head = head_.load(std::memory_order_acquire);
+			if (head & closedBit) {
+				return false;
+			}
+			if (tail - head < slots_.size()) {
+				break;
+			}
+			head_.wait(head, std::memory_order_acquire);
+		}
+		slots_[tail & (slots_.size() - 1)].emplace(std::move(value));
+		tail_.fetch_add(1, std::memory_order_release);
+		tail_.notify_one();
+		return true;
+	}
+
+	/**
+	 * @brief Blocks while the queue is empty, returns nothing once it is closed and drained
+	 */
+	std::optional<T> pop()
+	{
+		const std::size_t head = head_.load(std::memory_order_relaxed) & ~closedBit;
+		for (;;) {
+			const std::size_t tail = tail_.load(std::memory_order_acquire);
+			if ((tail & ~closedBit) != head) {
+				break;
+			}
+			if (tail & closedBit) {
+				return std::nullopt;
+			}
+			tail_.wait(tail, std::memory_order_acquire);
+		}
+		std::optional<T>& slot = slots_[head & (slots_.size() - 1)];
+		std::optional<T> result{std::move(slot)};
+		slot.reset();
+		head_.fetch_add(1, std::memory_order_release);
+		head_.notify_one();
+		return result;
+	}
+
+	void close()
+	{
+		// the counters only grow by one at a time, the flag bit is never reached otherwise
+		head_.fetch_or(closedBit, std::memory_order_acq_rel);
+		tail_.fetch_or(closedBit, std::memory_order_acq_rel);
+		head_.notify_all();
+		tail_.notify_all();
+	}
+
+private:
+	static constexpr std::size_t closedBit{std::size_t{1} << (std::numeric_limits<std::size_t>::digits - 1)};
+
+	std::vector<std::optional<T>> slots_;
+	// number of values popped, written by the consumer
+	alignas(64) std::atomic<std::size_t> head_{0};
+	// number of values pushed, written by the producer
+	alignas(64) std::atomic<std::size_t> tail_{0};
+};
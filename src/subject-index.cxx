@@ -0,0 +1,118 @@
+#include "subject-index.hxx"
+
+#include "commit.hxx"
+#include "trace.hxx"
+#include "utility.hxx"
+
+#include <git2/revwalk.h>
+
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <string>
+
+namespace {
+	std::string normalizeSubject(std::string_view subject)
+	{
+		std::string result;
+		result.reserve(subject.size());
+		for (char c: trimWhitespace(subject)) {
+			if (std::isspace(static_cast<unsigned char>(c))) {
+				if (result.back() != ' ') {
+					result += ' ';
+				}
+			} else {
+				result += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+			}
+		}
+		return result;
+	}
+
+	std::uint64_t subjectHash(std::string_view normalizedSubject)
+	{
+		return fnv1a(fnv1aOffsetBasis, normalizedSubject);
+	}
+} // namespace
+
+void SubjectIndex::add(const git_oid& id, std::string_view summary)
+{
+	commits_.emplace_back(subjectHash(normalizeSubject(summary)), id);
+}
+
+void SubjectIndex::setPendingTarget(const git_oid& tip, std::vector<git_oid> hidden)
+{
+	pendingTip_ = tip;
+	pendingHidden_ = std::move(hidden);
+}
+
+void SubjectIndex::setPendingSources(std::vector<git_oid> ids)
+{
+	pendingSources_ = std::move(ids);
+}
+
+void SubjectIndex::setDeadline(std::chrono::steady_clock::time_point deadline)
+{
+	deadline_ = deadline;
+}
+
+std::optional<git_oid> SubjectIndex::find(git_repository& repo, std::string_view subject)
+{
+	// the other threads looking up meanwhile wait for the build, nothing is locked afterwards
+	std::call_once(built_, [this, &repo] { build(repo); });
+
+	const std::string normalized{normalizeSubject(subject)};
+	auto [first, last] = std::ranges::equal_range(
+		commits_, subjectHash(normalized), std::less<>{}, &std::pair<std::uint64_t, git_oid>::first);
+	for (const auto& [hash, id]: std::ranges::subrange{first, last}) {
+		if (normalizeSubject(RawCommit{repo, id, RawCommit::Notes::Skip}.summary()) == normalized) {
+			return id;
+		}
+	}
+	return std::nullopt;
+}
+
+void SubjectIndex::build(git_repository& repo)
+{
+	TraceSpan span{"build subject index"};
+	// a lookup after a failed build starts over from the commits added up front
+	const std::size_t added{commits_.size()};
+	try {
+		readPending(repo);
+	} catch (...) {
+		commits_.resize(added);
+		throw;
+	}
+	pendingHidden_ = {};
+	pendingSources_ = {};
+
+	// the target commits were added first, the stable sort keeps them ahead of the source ones
+	std::ranges::stable_sort(commits_, std::less<>{}, &std::pair<std::uint64_t, git_oid>::first);
+}
+
+void SubjectIndex::readPending(git_repository& repo)
+{
+	if (pendingTip_) {
+		git_revwalk* walkPtr;
+		LibgitError::check(git_revwalk_new(&walkPtr, &repo));
+		std::unique_ptr<git_revwalk, git_revwalk_deleter> walk{walkPtr};
+		LibgitError::check(git_revwalk_push(walk.get(), &*pendingTip_));
+		for (const git_oid& id: pendingHidden_) {
+			LibgitError::check(git_revwalk_hide(walk.get(), &id));
+		}
+		git_oid id;
+		while (!git_revwalk_next(&id, walk.get())) {
+			read(repo, id);
+		}
+	}
+	for (const git_oid& id: pendingSources_) {
+		read(repo, id);
+	}
+}
+
+void SubjectIndex::read(git_repository& repo, const git_oid& id)
+{
+	if (deadline_ && std::chrono::steady_clock::now() >= *deadline_) {
+		throw DeadlineExpired{};
+	}
+	add(id, RawCommit{repo, id, RawCommit::Notes::Skip}.summary());
+}
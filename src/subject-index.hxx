@@ -0,0 +1,80 @@
+#pragma once
+
+#include "utility.hxx"
+
+#include <git2/types.h>
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Thrown by a lookup when the deadline expires before the index is built
+ */
+class DeadlineExpired: public std::runtime_error {
+public:
+	DeadlineExpired()
+		: std::runtime_error{"The deadline expired"}
+	{
+	}
+};
+
+/**
+ * @brief Commits of the scanned ranges by their subjects, for the references whose commit id does not resolve
+ *
+ * The subjects are compared with the whitespace collapsed and the case folded. The target commits scanned by this
+ * run are added with the summaries their scan parsed already, the loaded commits left for later (the source ones
+ * and the target ones of the previous runs) are read on the first lookup, which may come from any thread. Once
+ * built the index does not change, so the lookups do not lock. A subject found in the target range is preferred
+ * over the same one in the source range.
+ */
+class SubjectIndex {
+public:
+	SubjectIndex() = default;
+
+	SubjectIndex(const SubjectIndex&) = delete;
+	SubjectIndex& operator=(const SubjectIndex&) = delete;
+
+	/**
+	 * @brief Adds a target commit, must be called before the first lookup
+	 */
+	void add(const git_oid& id, std::string_view summary);
+
+	/**
+	 * @brief Target commits to read on the first lookup, those reachable from the tip and from none of the hidden
+	 */
+	void setPendingTarget(const git_oid& tip, std::vector<git_oid> hidden);
+
+	/**
+	 * @brief Source commits to read on the first lookup
+	 */
+	void setPendingSources(std::vector<git_oid> ids);
+
+	/**
+	 * @brief The build gives up at the deadline, the lookups throw DeadlineExpired then
+	 */
+	void setDeadline(std::chrono::steady_clock::time_point deadline);
+
+	/**
+	 * @brief Finds the commit, the candidates are verified with the repository handle of the caller
+	 */
+	std::optional<git_oid> find(git_repository& repo, std::string_view subject);
+
+private:
+	void build(git_repository& repo);
+	void readPending(git_repository& repo);
+	void read(git_repository& repo, const git_oid& id);
+
+	std::once_flag built_;
+	std::optional<git_oid> pendingTip_;
+	std::vector<git_oid> pendingHidden_;
+	std::vector<git_oid> pendingSources_;
+	std::optional<std::chrono::steady_clock::time_point> deadline_;
+	// by the hashes of the normalised subjects, sorted once built with the target commits first among the equal ones
+	std::vector<std::pair<std::uint64_t, git_oid>> commits_;
+};
@@ -0,0 +1,87 @@
+#include "trace.hxx"
+
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Trace::enabled_{false};
+
+namespace {
+	struct Event {
+		const char* name;
+		Trace::Clock::time_point start;
+		Trace::Clock::time_point end;
+	};
+
+	struct ThreadEvents {
+		unsigned thread;
+		std::vector<Event> events;
+	};
+
+	// the buffers outlive their threads, the session writes them after the workers are joined
+	std::mutex buffersMutex;
+	std::vector<std::shared_ptr<ThreadEvents>> buffers;
+	Trace::Clock::time_point sessionStart;
+
+	ThreadEvents& threadEvents()
+	{
+		thread_local std::shared_ptr<ThreadEvents> local;
+		if (!local) {
+			std::lock_guard lock{buffersMutex};
+			local = buffers.emplace_back(std::make_shared<ThreadEvents>(static_cast<unsigned>(buffers.size() + 1)));
+		}
+		return *local;
+	}
+
+	double microseconds(Trace::Clock::duration duration)
+	{
+		return std::chrono::duration<double, std::micro>{duration}.count();
+	}
+} // namespace
+
+void Trace::record(const char* name, Clock::time_point start, Clock::time_point end)
+{
+	threadEvents().events.push_back({name, start, end});
+}
+
+TraceSession::TraceSession(std::filesystem::path path)
+	: path_{std::move(path)}
+{
+	if (!path_.empty()) {
+		sessionStart = Trace::Clock::now();
+		// the thread starting the session gets the first lane
+		threadEvents();
+		Trace::enabled_.store(true, std::memory_order_relaxed);
+	}
+}
+
+TraceSession::~TraceSession()
+{
+	if (path_.empty()) {
+		return;
+	}
+	Trace::enabled_.store(false, std::memory_order_relaxed);
+
+	std::ofstream out{path_};
+	std::lock_guard lock{buffersMutex};
+	out << "{\"traceEvents\":[";
+	const char* separator = "\n";
+	for (const std::shared_ptr<ThreadEvents>& buffer: buffers) {
+		out << std::format(
+			"{}{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}", separator,
+			buffer->thread, buffer->thread == 1 ? "main" : std::format("worker {}", buffer->thread - 1));
+		separator = ",\n";
+		for (const Event& event: buffer->events) {
+			out << std::format(
+				",\n{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}", event.name,
+				buffer->thread, microseconds(event.start - sessionStart), microseconds(event.end - event.start));
+		}
+	}
+	out << "\n]}\n";
+	if (!out.flush()) {
+		std::cerr << "Error: could not write the trace to " << path_.string() << std::endl;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+
+/**
+ * @brief Timeline of the run in the Chrome trace event format, viewable in Perfetto or chrome://tracing
+ *
+ * The spans are collected per thread and written out when the session ends. Without an active session a span
+ * costs one relaxed atomic load.
+ */
+class Trace {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	static bool enabled() noexcept { return enabled_.load(std::memory_order_relaxed); }
+
+	/**
+	 * @brief Records a complete span, the name must outlive the session
+	 */
+	static void record(const char* name, Clock::time_point start, Clock::time_point end);
+
+private:
+	friend class TraceSession;
+
+	static std::atomic<bool> enabled_;
+};
+
+/**
+ * @brief Enables tracing for its lifetime and writes the trace file at the end, does nothing for an empty path
+ */
+class TraceSession {
+public:
+	explicit TraceSession(std::filesystem::path path);
+	~TraceSession();
+
+	TraceSession(const TraceSession&) = delete;
+	TraceSession& operator=(const TraceSession&) = delete;
+
+private:
+	std::filesystem::path path_;
+};
+
+/**
+ * @brief Records the span from construction to destruction
+ */
+class TraceSpan {
+public:
+	explicit TraceSpan(const char* name) noexcept
+		: name_{Trace::enabled() ? name : nullptr}
+	{
+		if (name_) {
+			start_ = Trace::Clock::now();
+		}
+	}
+
+	~TraceSpan()
+	{
+		if (name_) {
+			Trace::record(name_, start_, Trace::Clock::now());
+		}
+	}
+
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+	const char* name_;
+	Trace::Clock::time_point start_;
+};
@@ -2,14 +2,20 @@
 
 #include <git2/commit.h>
 #include <git2/config.h>
+#include <git2/object.h>
 #include <git2/oid.h>
+#include <git2/repository.h>
+#include <git2/revparse.h>
+#include <git2/revwalk.h>
 
 #include <algorithm>
 #include <array>
 #include <cctype>
 #include <cstdio>
+#include <cstring>
 #include <format>
 #include <memory>
+#include <stdexcept>
 
 namespace {
 	constexpr std::string_view ws{" \t\n\r\f\v"};
@@ -77,6 +83,40 @@ std::strong_ordering operator<=>(const git_oid& left, const git_oid& right)
 	return r > 0 ? std::strong_ordering::greater : (r < 0 ? std::strong_ordering::less : std::strong_ordering::equal);
 }
 
+std::size_t OidHash::operator()(const git_oid& id) const noexcept
+{
+	// object ids are uniformly distributed already
+	std::size_t result;
+	std::memcpy(&result, id.id, sizeof(result));
+	return result;
+}
+
+void git_repo_deleter::operator()(git_repository* repo) const
+{
+	git_repository_free(repo);
+}
+
+void git_revwalk_deleter::operator()(git_revwalk* walk) const
+{
+	git_revwalk_free(walk);
+}
+
+void git_commit_deleter::operator()(git_commit* commit) const
+{
+	git_commit_free(commit);
+}
+
+std::uint64_t fnv1a(std::uint64_t hash, std::string_view text)
+{
+	for (char c: text) {
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 0x100000001b3ull;
+	}
+	hash ^= 0xff;
+	hash *= 0x100000001b3ull;
+	return hash;
+}
+
 std::string& trimWhitespace(std::string& s)
 {
 	return trim(s);
@@ -114,9 +154,45 @@ std::string launch(const char* command)
 	return result;
 }
 
+std::string shellQuote(std::string_view text)
+{
+#ifdef _MSC_VER
+	// cmd.exe has no way to escape a double quote inside a quoted argument, file names can not contain them anyway
+	if (text.contains('"')) {
+		throw std::runtime_error(std::format("Can not pass {} to a command", text));
+	}
+	return std::format("\"{}\"", text);
+#else
+	// nothing is special inside single quotes, a quote itself ends them, is escaped and starts them again
+	std::string result{'\''};
+	for (char c: text) {
+		if (c == '\'') {
+			result += "'\\''";
+		} else {
+			result += c;
+		}
+	}
+	result += '\'';
+	return result;
+#endif
+}
+
 std::string oid_to_string(const git_oid& oid)
 {
 	std::string result(40, 0);
 	git_oid_fmt(result.data(), &oid);
 	return result;
 }
+
+git_oid resolve_commit(git_repository& repo, const std::string& spec)
+{
+	git_object* object;
+	LibgitError::check(git_revparse_single(&object, &repo, spec.c_str()));
+	git_object* commit;
+	int error = git_object_peel(&commit, object, GIT_OBJECT_COMMIT);
+	git_object_free(object);
+	LibgitError::check(error);
+	git_oid result{*git_object_id(commit)};
+	git_object_free(commit);
+	return result;
+}
@@ -5,6 +5,7 @@
 
 #include <cassert>
 #include <compare>
+#include <cstdint>
 #include <stdexcept>
 #include <string>
 #include <string_view>
@@ -32,7 +33,41 @@ inline bool operator==(const git_oid& left, const git_oid& right)
 	return (left <=> right) == std::strong_ordering::equal;
 }
 
+struct OidHash {
+	std::size_t operator()(const git_oid& id) const noexcept;
+};
+
+// for std::unique_ptr owning the libgit2 objects
+struct git_repo_deleter {
+	void operator()(git_repository* repo) const;
+};
+
+struct git_revwalk_deleter {
+	void operator()(git_revwalk* walk) const;
+};
+
+struct git_commit_deleter {
+	void operator()(git_commit* commit) const;
+};
+
+constexpr std::uint64_t fnv1aOffsetBasis{0xcbf29ce484222325ull};
+
+/**
+ * @brief Adds the text to the FNV-1a hash, consecutive texts are kept apart
+ */
+std::uint64_t fnv1a(std::uint64_t hash, std::string_view text);
+
 std::string& trimWhitespace(std::string& s);
 std::string_view trimWhitespace(std::string_view s);
 std::string launch(const char* command);
 std::string oid_to_string(const git_oid& oid);
+
+/**
+ * @brief Quotes the text as one argument of a command for launch(), whatever characters it contains
+ */
+std::string shellQuote(std::string_view text);
+
+/**
+ * @brief Id of the commit the revspec points to, throws LibgitError if there is none
+ */
+git_oid resolve_commit(git_repository& repo, const std::string& spec);